@@ -0,0 +1,85 @@
+#pragma once
+#include "ezgl.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Records the default framebuffer as an image sequence without stalling the render loop. EXR
+// frames are read from the float texture the frame was presented from instead, the 8 bit
+// framebuffer has already lost the range they are meant to keep.
+// Frames are read into a ring of pixel buffers guarded by fences, mapped once the GPU is done
+// and encoded by a pool of worker threads. When every buffer is in flight capture() waits for
+// the oldest one instead of buffering more frames.
+class FrameCapture
+{
+  private:
+    enum SlotState
+    {
+        Free,
+        Pending,  // readback queued, fence not signalled yet
+        Mapped,   // owned by a worker reading the mapped memory
+        Released, // worker is done with the memory, needs unmapping
+    };
+
+    struct Slot
+    {
+        ez::PixelBuffer pbo{"capture ring"};
+        GLsync fence = nullptr;
+        std::atomic<int> state = Free;
+        uint8_t const *data = nullptr;
+        bool floats = false;
+        int32_t width = 0, height = 0;
+        uint64_t frame = 0;
+    };
+
+    std::string directory;
+    std::string extension;
+    std::vector<std::unique_ptr<Slot>> slots;
+    uint32_t head = 0;
+    uint64_t frameCounter = 0;
+
+    std::vector<std::thread> workers;
+    std::deque<Slot *> jobs;
+    std::mutex jobsMutex;
+    std::condition_variable jobsCondition;
+    bool stopping = false;
+
+    std::atomic<uint64_t> written = 0;
+    uint64_t stalls = 0;
+    // Render thread time spent in capture(), the readback itself runs asynchronously
+    double lastCaptureMs = 0;
+    double totalCaptureMs = 0;
+    double maxCaptureMs = 0;
+
+    Slot &acquire(int32_t width, int32_t height, bool floats);
+    void submit(Slot &slot, std::chrono::steady_clock::time_point start);
+    void handOff(Slot &slot);
+    void recycle(Slot &slot);
+    void work();
+
+  public:
+    FrameCapture(std::string const &directory, std::string const &extension, uint32_t ringSize = 3,
+                 uint32_t workerCount = 0);
+    ~FrameCapture();
+
+    // Queues a readback of the current read framebuffer, call right after drawing the frame
+    void capture(int32_t width, int32_t height);
+    // Queues a readback of an RGBA32F texture, row zero at the top
+    void capture(ez::Texture &texture);
+    // Whether frames have to come from a float texture, see capture(ez::Texture &)
+    bool needsFloatSource();
+    // Hands finished readbacks to the workers and recycles buffers they released
+    void poll();
+
+    double getLastCaptureMs();
+    double getAverageCaptureMs();
+    uint64_t getFramesWritten();
+    uint64_t getStalls();
+};
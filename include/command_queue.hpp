@@ -0,0 +1,109 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Bounded lock-free queue after Dmitry Vyukov's MPMC ring. Any number of threads may push,
+// the render thread pops. Neither side allocates or takes a lock, a full queue rejects the push.
+template <typename T, size_t Capacity> class CommandQueue
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity has to be a power of two");
+
+  private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T data;
+    };
+
+    std::array<Cell, Capacity> cells;
+    alignas(64) std::atomic<size_t> enqueuePos = 0;
+    alignas(64) std::atomic<size_t> dequeuePos = 0;
+
+  public:
+    CommandQueue();
+    CommandQueue(CommandQueue const &) = delete;
+    CommandQueue &operator=(CommandQueue const &) = delete;
+
+    bool push(T const &value);
+    bool pop(T &value);
+    // Pops until the queue is empty and hands every command to f, returns how many there were
+    template <typename F> size_t drain(F &&f);
+};
+
+template <typename T, size_t Capacity> CommandQueue<T, Capacity>::CommandQueue()
+{
+    for (size_t i = 0; i < Capacity; i++)
+    {
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+template <typename T, size_t Capacity> bool CommandQueue<T, Capacity>::push(T const &value)
+{
+    size_t pos = enqueuePos.load(std::memory_order_relaxed);
+    while (true)
+    {
+        Cell &cell = cells[pos & (Capacity - 1)];
+        size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        intptr_t diff = intptr_t(sequence) - intptr_t(pos);
+        if (diff == 0)
+        {
+            if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                cell.data = value;
+                cell.sequence.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+        }
+        else if (diff < 0)
+        {
+            return false;
+        }
+        else
+        {
+            pos = enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+template <typename T, size_t Capacity> bool CommandQueue<T, Capacity>::pop(T &value)
+{
+    size_t pos = dequeuePos.load(std::memory_order_relaxed);
+    while (true)
+    {
+        Cell &cell = cells[pos & (Capacity - 1)];
+        size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        intptr_t diff = intptr_t(sequence) - intptr_t(pos + 1);
+        if (diff == 0)
+        {
+            if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                value = cell.data;
+                cell.sequence.store(pos + Capacity, std::memory_order_release);
+                return true;
+            }
+        }
+        else if (diff < 0)
+        {
+            return false;
+        }
+        else
+        {
+            pos = dequeuePos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+template <typename T, size_t Capacity> template <typename F> size_t CommandQueue<T, Capacity>::drain(F &&f)
+{
+    size_t count = 0;
+    T value;
+    while (pop(value))
+    {
+        f(value);
+        count++;
+    }
+    return count;
+}
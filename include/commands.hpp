@@ -0,0 +1,56 @@
+#pragma once
+#include "command_queue.hpp"
+#include "scene.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <variant>
+
+// Everything that changes render state from outside the render loop is posted as one of these
+// and applied by the render thread at the start of the next frame.
+
+struct RecompileShaders
+{
+};
+
+struct ShaderFileChanged
+{
+    char filename[128];
+
+    ShaderFileChanged(std::string_view name = "")
+    {
+        size_t size = std::min(name.size(), sizeof(filename) - 1);
+        std::memcpy(filename, name.data(), size);
+        filename[size] = 0;
+    }
+};
+
+struct MoveCamera
+{
+    float dz;
+};
+
+struct AddSphere
+{
+    Sphere sphere;
+};
+
+struct UpdateSphere
+{
+    uint32_t index;
+    Sphere sphere;
+};
+
+struct RemoveSphere
+{
+    uint32_t index;
+};
+
+using Command = std::variant<RecompileShaders, ShaderFileChanged, MoveCamera, AddSphere, UpdateSphere, RemoveSphere>;
+using Commands = CommandQueue<Command, 1024>;
+
+template <class... Ts> struct overloaded : Ts...
+{
+    using Ts::operator()...;
+};
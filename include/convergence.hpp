@@ -0,0 +1,59 @@
+#pragma once
+#include "cpu_tracer.hpp"
+#include "image.hpp"
+#include "mesh.hpp"
+#include "scene.hpp"
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Error of a progressively rendered image against a high sample reference over wall-clock time,
+// the acceptance metric for tracer changes: a better tracer reaches a lower error sooner.
+
+struct ConvergenceOptions
+{
+    // Samples per pixel of the reference, rendered once per scene and settings and cached
+    uint32_t referenceSamples = 1024;
+    std::string referenceDirectory = "convergence/reference";
+    double intervalSeconds = 0.5;
+    double durationSeconds = 10.0;
+};
+
+struct ConvergenceSample
+{
+    // Render time only, measuring the error is not counted
+    double seconds;
+    uint32_t passes;
+    uint32_t samples;
+    double rmse;
+    // Squared error relative to the squared reference value, so dark regions count as much as bright ones
+    double relMse;
+};
+
+// A progressive renderer under test, render is timed and estimate is not
+struct PassRenderer
+{
+    // Adds one pass of `samples` samples per pixel, every pass has to use a new seed
+    std::function<void(uint32_t pass)> render;
+    // Writes the average of every pass so far into image
+    std::function<void(Image &image)> estimate;
+};
+
+// Averages the passes of tracer on the CPU
+PassRenderer cpuPassRenderer(CpuTracer const &tracer, int32_t width, int32_t height);
+
+// Loads the cached reference for scene and settings or renders and caches it with the CpuTracer
+bool loadReference(std::string const &scene, std::vector<Sphere> const &spheres, MeshBuffers const &meshes,
+                   TraceSettings const &settings, int32_t width, int32_t height, ConvergenceOptions const &options,
+                   Image &reference);
+
+void imageError(Image const &image, Image const &reference, double &rmse, double &relMse);
+
+// Renders passes until the duration is used up and records the error of the estimate every interval
+std::vector<ConvergenceSample> measureConvergence(Image const &reference, uint32_t samplesPerPass,
+                                                  PassRenderer const &renderer, ConvergenceOptions const &options);
+
+// Writes path.csv and path.json
+bool writeConvergence(std::string const &path, std::string const &scene, std::string const &tracer,
+                      TraceSettings const &settings, std::vector<ConvergenceSample> const &curve);
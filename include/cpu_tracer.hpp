@@ -0,0 +1,80 @@
+#pragma once
+#include "image.hpp"
+#include "mesh.hpp"
+#include "scene.hpp"
+#include <cstdint>
+#include <vector>
+
+// CPU reference of the path tracer in shaders/quad.fsh, same camera and estimator
+class CpuTracer
+{
+  private:
+    struct Ray
+    {
+        glm::vec3 origin;
+        glm::vec3 direction;
+    };
+
+    struct HitInfo
+    {
+        glm::vec3 pos;
+        glm::vec3 normal;
+        bool front_face;
+        float t;
+    };
+
+    // Ray sheared so its direction becomes +z, shared by every triangle test of the ray
+    struct RayShear
+    {
+        int kx, ky, kz;
+        glm::vec3 s;
+    };
+
+    struct Material
+    {
+        glm::vec3 color;
+        glm::vec3 emission;
+    };
+
+    struct Rng
+    {
+        uint32_t state;
+        float next();
+    };
+
+    std::vector<Sphere> spheres;
+    std::vector<int32_t> lights;
+    MeshBuffers meshes;
+    // Unpacked once, indexed like the packed vertices
+    std::vector<glm::vec3> positions, normals;
+    TraceSettings settings;
+    uint32_t threads = 0;
+
+    bool hitSphere(Sphere const &sphere, Ray const &ray, float t_min, float t_max, HitInfo &hitinfo) const;
+    static RayShear rayShear(Ray const &ray);
+    bool hitTriangle(MeshInfo const &mesh, uint32_t triangle, Ray const &ray, RayShear const &shear, float t_min,
+                     float t_max, HitInfo &hitinfo) const;
+    // Spheres come first, then one index per mesh
+    int32_t getWorldHit(Ray const &ray, HitInfo &hitinfo) const;
+    Material material(int32_t index) const;
+    glm::vec3 sampleLight(HitInfo const &hitinfo, Rng &rng) const;
+    glm::vec3 rayColor(Ray ray, Rng &rng) const;
+    glm::vec3 pixelColor(int32_t x, int32_t y, int32_t width, int32_t height, uint32_t seed) const;
+
+  public:
+    // Bump when a change alters the image the estimator converges to, cached references depend on it
+    static constexpr uint32_t version = 1;
+
+    CpuTracer(std::vector<Sphere> const &spheres, TraceSettings const &settings);
+    CpuTracer(std::vector<Sphere> const &spheres, MeshBuffers const &meshes, TraceSettings const &settings);
+
+    // Zero uses every core
+    void setThreads(uint32_t threads);
+
+    // Renders `samples` samples per pixel of the tile into image, the image size defines the camera
+    void render(Image &image, Tile const &tile, uint32_t seed = 0) const;
+    void render(Image &image, uint32_t seed = 0) const;
+
+    // Closest hit queries per second for one camera ray per pixel, without any shading
+    double intersectionThroughput(int32_t width, int32_t height) const;
+};
@@ -0,0 +1,45 @@
+#pragma once
+#include "image.hpp"
+#include "mesh.hpp"
+#include "scene.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Coordinator/worker tile rendering over TCP or Unix sockets. The coordinator sends the scene to
+// every worker that connects and hands out tiles, workers trace them with the CpuTracer and send
+// the pixels back. Addresses look like "unix:/tmp/ray.sock" or "tcp:host:port".
+
+struct DistributedOptions
+{
+    std::string address;
+    // Workers forked from this executable and connected to address, on top of remote ones
+    uint32_t localWorkers = 0;
+    // Threads per local worker, zero uses every core
+    uint32_t workerThreads = 0;
+    int32_t tileSize = 64;
+    // Tiles in flight per worker, hides the round trip
+    uint32_t queueDepth = 2;
+    // A tile is handed to a second worker once it has been out this many times the average tile time
+    double stealFactor = 3.0;
+    // A worker holding tiles that sends nothing for this long, or ten average tile times if longer, is
+    // dropped and its tiles are reassigned
+    double workerTimeoutSeconds = 60.0;
+};
+
+struct DistributedStats
+{
+    double seconds = 0;
+    uint32_t workers = 0;
+    // Workers that disconnected before the image was done, their tiles were reassigned
+    uint32_t failures = 0;
+    // Tiles handed to a second worker because the first one was slow
+    uint32_t stolen = 0;
+    std::vector<uint32_t> tilesPerWorker;
+};
+
+bool renderDistributed(std::vector<Sphere> const &spheres, MeshBuffers const &meshes, TraceSettings const &settings,
+                       Image &image, DistributedOptions const &options, DistributedStats &stats);
+
+// Serves tiles until the coordinator shuts the worker down, returns the process exit code
+int runWorker(std::string const &address, uint32_t threads);
@@ -1,9 +1,15 @@
 #pragma once
+#include <array>
+#include <atomic>
 #include <cstddef>
 #include <cstdlib>
+#include <functional>
 #include <initializer_list>
+#include <map>
 #include <string>
+#include <unordered_map>
 #include <utility>
+#include <vector>
 #define GLAD_GL_IMPLEMENTATION
 #include <efsw/efsw.hpp>
 #include <gl.h>
@@ -15,6 +21,106 @@ namespace ez
 GLint getGLTypeSize(GLenum type);
 void checkError();
 
+struct CallStats
+{
+    uint32_t calls = 0;
+    uint32_t skipped = 0;
+};
+
+enum class ResourceType
+{
+    Buffer,
+    Texture,
+    Program,
+};
+
+// A live GL object holding GPU memory
+struct Resource
+{
+    ResourceType type;
+    std::string label;
+    size_t bytes = 0;
+    // Usage hint of buffers, internal format of textures, zero for programs
+    GLenum usage = 0;
+    // Times the storage was specified, one that keeps growing points at setData where setSubData would do
+    uint32_t allocations = 0;
+};
+
+struct MemoryStats
+{
+    size_t bytes = 0;
+    size_t peakBytes = 0;
+    // Indexed by ResourceType
+    std::array<size_t, 3> typeBytes{};
+    // Maximum of each type on its own, reached at different times so they do not sum to peakBytes
+    std::array<size_t, 3> typePeakBytes{};
+    std::array<uint32_t, 3> typeCount{};
+};
+
+// Mirror of the binding state of the current context, every ezgl wrapper goes through it so
+// binding an object that is already bound costs no GL call. Code that binds objects behind its
+// back has to call invalidateState() afterwards.
+struct ContextState
+{
+    bool directStateAccess = false;
+    GLuint program = 0;
+    GLuint vertexArray = 0;
+    GLuint activeTexture = 0;
+    std::unordered_map<GLenum, GLuint> buffers;
+    // Keyed by texture unit and target
+    std::map<std::pair<GLuint, GLenum>, GLuint> textures;
+    std::map<std::pair<GLenum, GLuint>, GLuint> bufferBases;
+    CallStats frame;
+    std::map<std::pair<ResourceType, GLuint>, Resource> resources;
+    MemoryStats memory;
+};
+
+// One context per thread, which is how GL makes contexts current anyway
+ContextState &state();
+// Loads GL 4.5 direct state access entry points when the context has them, call after gladLoadGL
+void loadExtensions(GLADloadproc load);
+bool hasDirectStateAccess();
+void invalidateState();
+// Returns the counters of the frame that just finished and starts a new one
+CallStats endFrame();
+
+// Memory accounting, sizes are what ezgl asked for, drivers may round up or keep extra copies
+void trackResource(ResourceType type, GLuint id, std::string const &label);
+// Also applies the label with glObjectLabel the first time, the object exists by then
+void setResourceSize(ResourceType type, GLuint id, size_t bytes, GLenum usage);
+void untrackResource(ResourceType type, GLuint id);
+std::map<std::pair<ResourceType, GLuint>, Resource> const &resources();
+MemoryStats const &memoryStats();
+char const *resourceTypeName(ResourceType type);
+// Name of a usage hint or internal format, the hex value for others
+std::string usageName(GLenum usage);
+// Peak and live usage, call before the context goes away
+void logMemoryUsage();
+
+void bindBuffer(GLenum target, GLuint id);
+void bindBufferBase(GLenum target, GLuint index, GLuint id);
+void useProgram(GLuint id);
+void bindVertexArray(GLuint id);
+void activeTexture(GLuint unit);
+// Binds to the active texture unit
+void bindTexture(GLenum target, GLuint id);
+void deleteTexture(GLuint id);
+
+GLuint createBuffer(std::string const &label = "");
+void deleteBuffer(GLuint id);
+void bufferData(GLuint id, GLenum target, GLsizeiptr size, void const *data, GLenum usage);
+void bufferSubData(GLuint id, GLenum target, GLintptr offset, GLsizeiptr size, void const *data);
+
+// Plain GL calls, wrapped so they show up in the frame counters
+void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+void clear(GLbitfield mask);
+void memoryBarrier(GLbitfield barriers);
+void readPixels(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, void *pixels);
+// Signaled once everything submitted so far has finished
+GLsync fenceSync();
+GLenum clientWaitSync(GLsync sync, GLbitfield flags, GLuint64 timeout);
+void deleteSync(GLsync sync);
+
 class VertexBuffer
 {
   private:
@@ -22,17 +128,17 @@ class VertexBuffer
     bool dynamic;
 
   public:
-    VertexBuffer(bool dynamic = false);
+    VertexBuffer(bool dynamic = false, std::string const &label = "");
     ~VertexBuffer();
 
+    GLuint getId();
     void bind();
     template <typename T> void setData(T *data, size_t count);
 };
 
 template <typename T> void VertexBuffer::setData(T *data, size_t count)
 {
-    this->bind();
-    glBufferData(GL_ARRAY_BUFFER, sizeof(T) * count, data, this->dynamic ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW);
+    bufferData(this->id, GL_ARRAY_BUFFER, sizeof(T) * count, data, this->dynamic ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW);
 }
 
 class VertexArray
@@ -45,31 +151,51 @@ class VertexArray
     ~VertexArray();
 
     void bind();
-    void attributes(std::initializer_list<std::pair<GLenum, GLint>> elements);
+    void attributes(VertexBuffer &buffer, std::initializer_list<std::pair<GLenum, GLint>> elements);
+    void draw(GLenum mode, GLint first, GLsizei count);
 };
 
 class Program : public efsw::FileWatchListener
 {
+  public:
+    // Called on the file watcher thread for every added file in shaders/
+    using FileChangedHandler = std::function<void(std::string const &filename)>;
+
   private:
-    GLint id;
-    efsw::FileWatcher watcher;
+    GLint id = 0;
     bool autoreload;
-    std::string vertexPath;
-    std::string fragmentPath;
+    std::vector<std::pair<GLenum, std::string>> stages;
     std::vector<std::string> includedFiles;
-    bool needsRecompile = false;
+    FileChangedHandler onFileChanged;
+    std::atomic<bool> needsRecompile = false;
+    uint32_t generation = 0;
+    std::unordered_map<std::string, GLint> uniformLocations;
     void compile();
+    GLint location(std::string const &name);
+    std::string label();
+    // Last so it is destroyed first, its thread calls handleFileAction which reads the members above
+    efsw::FileWatcher watcher;
 
   public:
-    Program(std::string const &vertex_path, std::string const &fragment_path, bool autoreload = false);
+    Program(std::string const &vertex_path, std::string const &fragment_path, bool autoreload = false,
+            FileChangedHandler onFileChanged = nullptr);
+    // Any combination of shader stages, e.g. {{GL_COMPUTE_SHADER, "shaders/sweep.csh"}}
+    Program(std::initializer_list<std::pair<GLenum, std::string>> stages, bool autoreload = false,
+            FileChangedHandler onFileChanged = nullptr);
     ~Program();
 
     void recompile();
+    // Schedules a recompile if filename is one of the sources, call from the render thread
+    void fileChanged(std::string const &filename);
     void use();
+    void dispatch(GLuint x, GLuint y, GLuint z);
+    // Counts successful compiles, changes whenever the shaders did
+    uint32_t getGeneration();
     void setInt(std::string const &name, uint32_t value);
     void setFloat(std::string const &name, float value);
     void setVec2(std::string const &name, glm::vec2 const &value);
     void setVec2(std::string const &name, float v1, float v2);
+    void setIVec2(std::string const &name, glm::ivec2 const &value);
     void setVec3(std::string const &name, glm::vec3 const &value);
     void setVec3(std::string const &name, float v1, float v2, float v3);
     void setVec4(std::string const &name, glm::vec4 const &value);
@@ -86,7 +212,7 @@ class SSBO
     GLuint id;
 
   public:
-    SSBO();
+    SSBO(std::string const &label = "");
     ~SSBO();
     void bind();
     void layout(GLint binding);
@@ -95,14 +221,81 @@ class SSBO
 };
 template <typename T> void SSBO::setData(T *data, size_t count)
 {
-    this->bind();
-    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(T) * count, data, GL_DYNAMIC_COPY);
+    bufferData(this->id, GL_SHADER_STORAGE_BUFFER, sizeof(T) * count, data, GL_DYNAMIC_COPY);
 }
 
 template <typename T> void SSBO::setSubData(T *data, size_t start, size_t count)
 {
-    this->bind();
-    glBufferSubData(GL_SHADER_STORAGE_BUFFER, sizeof(T) * start, sizeof(T) * count, data + start);
+    bufferSubData(this->id, GL_SHADER_STORAGE_BUFFER, sizeof(T) * start, sizeof(T) * count, data + start);
 }
 
+class PixelBuffer
+{
+  private:
+    GLuint id;
+    size_t size = 0;
+
+  public:
+    PixelBuffer(std::string const &label = "");
+    ~PixelBuffer();
+    void bind();
+    void allocate(size_t size);
+    size_t getSize();
+    void *map();
+    void unmap();
+};
+
+// RGBA32F texture, written by compute shaders through image units and sampled for display
+class Texture
+{
+  private:
+    GLuint id;
+    int32_t width, height;
+
+  public:
+    Texture(int32_t width, int32_t height, std::string const &label = "");
+    ~Texture();
+
+    int32_t getWidth();
+    int32_t getHeight();
+    void bind(GLuint unit);
+    void bindImage(GLuint unit, GLenum access);
+    // RGBA floats, row zero first
+    std::vector<float> read();
+    // Same layout into the bound pixel pack buffer, returns without waiting for the GPU
+    void readToPixelBuffer();
+};
+
+class TimerQuery
+{
+  private:
+    GLuint id;
+
+  public:
+    TimerQuery();
+    ~TimerQuery();
+
+    void begin();
+    void end();
+    bool available();
+    // GPU time between begin and end, only valid once available
+    double milliseconds();
+};
+
+// Layered RGBA32F texture, written by compute shaders through image units
+class TextureArray
+{
+  private:
+    GLuint id;
+    int32_t width, height, layers;
+
+  public:
+    TextureArray(int32_t width, int32_t height, int32_t layers, std::string const &label = "");
+    ~TextureArray();
+
+    void bindImage(GLuint unit, GLenum access);
+    // Reads every layer back as tightly packed RGBA floats, layer after layer
+    std::vector<float> read();
+};
+
 } // namespace ez
@@ -0,0 +1,38 @@
+#pragma once
+#include "ezgl.hpp"
+#include "image.hpp"
+#include "mesh.hpp"
+#include "scene.hpp"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Progressive renderer around shaders/tile.csh, the GPU counterpart of CpuTracer for benchmarks.
+// Needs a current GL context, e.g. from a Window.
+class GpuTracer
+{
+  private:
+    ez::Program program;
+    std::vector<int32_t> lights;
+    ez::SSBO sphereSSBO, lightSSBO, meshSSBO, meshVertexSSBO, meshIndexSSBO;
+    uint32_t sphereCount, meshCount;
+    TraceSettings settings;
+    std::unique_ptr<ez::Texture> frame;
+    uint32_t passes = 0;
+
+    void setUniforms(TraceSettings const &trace);
+    void dispatch();
+
+  public:
+    GpuTracer(std::vector<Sphere> const &spheres, MeshBuffers const &meshes, TraceSettings const &settings);
+
+    // Starts a new image, the next pass overwrites instead of averaging
+    void reset(int32_t width, int32_t height);
+    // Averages one more pass of settings.samples samples per pixel into the image and waits for it
+    void renderPass(uint32_t seed);
+    // Average of every pass since reset
+    void read(Image &image);
+
+    // Closest hit queries per second for one camera ray per pixel, the only shading is the material fetch
+    double intersectionThroughput(int32_t width, int32_t height);
+};
@@ -0,0 +1,35 @@
+#pragma once
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+struct Tile
+{
+    int32_t x, y;
+    int32_t width, height;
+};
+
+// Linear RGB image stored top row first
+struct Image
+{
+    int32_t width = 0, height = 0;
+    std::vector<glm::vec3> pixels;
+
+    Image() = default;
+    Image(int32_t width, int32_t height);
+
+    glm::vec3 &at(int32_t x, int32_t y);
+    glm::vec3 const &at(int32_t x, int32_t y) const;
+};
+
+bool writePPM(std::string const &path, Image const &image);
+// Uncompressed deflate, readable everywhere and cheap to produce
+bool writePNG(std::string const &path, Image const &image);
+// Uncompressed 32 bit float scanline OpenEXR
+bool writeEXR(std::string const &path, Image const &image);
+// Portable float map, lossless and trivial to read back
+bool writePFM(std::string const &path, Image const &image);
+bool readPFM(std::string const &path, Image &image);
+// Picks the encoder from the file extension, PPM for unknown or missing ones
+bool writeImage(std::string const &path, Image const &image);
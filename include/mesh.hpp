@@ -0,0 +1,58 @@
+#pragma once
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+// Indexed triangle mesh as loaded, positions in world space
+struct Mesh
+{
+    std::vector<glm::vec3> positions;
+    // One per position, computed from the faces when the file has none
+    std::vector<glm::vec3> normals;
+    std::vector<glm::uvec3> triangles;
+    glm::vec3 color = glm::vec3(0.7, 0.7, 0.7);
+    glm::vec3 emission = glm::vec3(0, 0, 0);
+};
+
+// Wavefront OBJ, polygons are triangulated as fans, texture coordinates are ignored
+bool loadOBJ(std::string const &path, Mesh &mesh);
+// ASCII and binary PLY with x, y, z and optionally nx, ny, nz vertex properties
+bool loadPLY(std::string const &path, Mesh &mesh);
+// Picks the loader from the file extension
+bool loadMesh(std::string const &path, Mesh &mesh);
+// Moves and scales mesh so its bounding box is centred on center and its longest side is size
+void fitMesh(Mesh &mesh, glm::vec3 center, float size);
+
+// One mesh of MeshBuffers, laid out like MeshInfo in shaders/trace.glsl (std430)
+struct MeshInfo
+{
+    alignas(16) glm::vec3 bounds_min;
+    uint32_t first_vertex;
+    alignas(16) glm::vec3 bounds_extent;
+    uint32_t first_triangle;
+    alignas(16) glm::vec3 color;
+    uint32_t triangle_count;
+    alignas(16) glm::vec3 emission;
+};
+
+// Words per packed vertex: 21/21/22 bit positions relative to the mesh bounds in the first two,
+// the octahedral normal as two snorm16 in the third
+static constexpr uint32_t vertexWords = 3;
+
+// Every mesh of a scene packed for the SSBOs at bindings 6, 7 and 8, the CPU tracer reads the
+// same data so both paths intersect identical geometry
+struct MeshBuffers
+{
+    std::vector<MeshInfo> meshes;
+    std::vector<uint32_t> vertices;
+    // Three per triangle, relative to the first_vertex of its mesh
+    std::vector<uint32_t> indices;
+
+    size_t triangleCount() const;
+    size_t bytes() const;
+};
+
+MeshBuffers packMeshes(std::vector<Mesh> const &meshes);
+glm::vec3 unpackPosition(MeshInfo const &mesh, uint32_t const *vertex);
+glm::vec3 unpackNormal(uint32_t word);
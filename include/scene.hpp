@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+struct Sphere
+{
+    alignas(16) glm::vec3 origin;
+    alignas(16) glm::vec3 color;
+    float radius;
+    alignas(16) glm::vec3 emission;
+
+    Sphere(glm::vec3 origin, float radius, glm::vec3 color = glm::vec3(0.7, 0.7, 0.7),
+           glm::vec3 emission = glm::vec3(0, 0, 0))
+    {
+        this->origin = origin;
+        this->radius = radius;
+        this->color = color;
+        this->emission = emission;
+    }
+
+    bool isEmissive() const
+    {
+        return emission.x > 0 || emission.y > 0 || emission.z > 0;
+    }
+};
+
+struct TraceSettings
+{
+    float viewport_size = 2.0;
+    float focal_length = 7.0;
+    float camera_z = 17.0;
+    float t_min = 0.1;
+    float t_max = 100.0;
+    int max_ray_reflections = 3;
+    int samples = 1;
+    bool light_sampling = true;
+
+    bool operator==(TraceSettings const &) const = default;
+};
+
+std::vector<Sphere> defaultScene();
+// Closed room lit only by small emissive spheres, nothing reaches the sky
+std::vector<Sphere> indoorScene();
+std::vector<Sphere> sceneByName(std::string const &name);
+// Every name sceneByName knows
+std::vector<std::string> sceneNames();
+
+// Indices of all emissive spheres, uploaded next to the spheres for light sampling
+std::vector<int32_t> lightIndices(std::vector<Sphere> const &spheres);
@@ -0,0 +1,39 @@
+#pragma once
+#include "image.hpp"
+#include "mesh.hpp"
+#include "scene.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// One parameter set of a sweep, laid out like SweepParams in shaders/sweep.csh (std430)
+struct SweepParams
+{
+    float viewport_size;
+    float focal_length;
+    float camera_z;
+    float t_min;
+    float t_max;
+    int32_t max_ray_reflections;
+    int32_t samples;
+    int32_t light_sampling;
+    // Sphere whose color is replaced by color, -1 for none
+    int32_t color_sphere = -1;
+    alignas(16) glm::vec3 color = glm::vec3(0);
+};
+
+struct SweepResult
+{
+    std::vector<Image> images;
+    double batchedSeconds = 0;
+    double sequentialSeconds = 0;
+};
+
+// Reads a JSON array of parameter sets, keys are named like the TraceSettings members plus
+// "color_sphere" and "color", missing keys fall back to defaults
+std::vector<SweepParams> loadSweep(std::string const &path, TraceSettings const &defaults);
+
+// Renders every parameter set into its own layer of a texture array with a single compute dispatch.
+// With compareSequential the same images are rendered once more with one dispatch per set for timing.
+SweepResult renderSweep(std::vector<SweepParams> const &sweep, std::vector<Sphere> const &spheres,
+                        MeshBuffers const &meshes, int32_t width, int32_t height, bool compareSequential);
@@ -0,0 +1,63 @@
+#pragma once
+#include "ezgl.hpp"
+#include "image.hpp"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Spreads one image over several frames. The frame is cut into tiles, each frame renders as many
+// of them as fit into the GPU time budget. The cost per pixel is learned from timer queries,
+// whose results arrive a few frames late, so they are kept in a small ring and never waited on.
+// A tile estimated to cost more than the whole budget is split first, down to one 8x8 workgroup.
+class TileScheduler
+{
+  private:
+    struct Measurement
+    {
+        ez::TimerQuery query;
+        int64_t pixels = 0;
+        bool pending = false;
+    };
+
+    int32_t tileSize;
+    int32_t width = 0, height = 0;
+    std::vector<Tile> tiles;
+    size_t next = 0;
+    // Set once a tile was split, restart() cuts the image anew then
+    bool split = false;
+    // Frames whose estimated cost exceeded the budget, only possible once tiles are at the minimum size
+    uint64_t overBudgetFrames = 0;
+
+    std::vector<std::unique_ptr<Measurement>> measurements;
+    uint32_t measurementHead = 0;
+    // Exponential moving average, zero until the first measurement arrived
+    double msPerPixel = 0;
+    double lastFrameMs = 0;
+
+    void collect();
+    void splitNext();
+
+  public:
+    float budgetMs;
+
+    TileScheduler(int32_t tileSize = 64, float budgetMs = 8.0f);
+
+    // Starts the image over, tiles closest to the centre come first. Pass resetEstimate when the
+    // cost per pixel changed a lot so the first frame after it renders a single tile.
+    void restart(int32_t width, int32_t height, bool resetEstimate = false);
+    void setTileSize(int32_t tileSize);
+    int32_t getTileSize();
+
+    // Calls renderTile for this frame's share of tiles, at least one while the image is unfinished
+    void renderFrame(std::function<void(Tile const &)> const &renderTile);
+
+    bool done();
+    float progress();
+    size_t tilesDone();
+    size_t tileCount();
+    double getMsPerPixel();
+    // Measured GPU time of the most recent frame with a finished query
+    double getLastFrameMs();
+    uint64_t getOverBudgetFrames();
+};
@@ -2,17 +2,7 @@
 #define FLT_MIN 1.175494351e-38
 #define DBL_MAX 1.7976931348623158e+308
 #define DBL_MIN 2.2250738585072014e-308
-
-uniform float t_min = 0.1;
-uniform float t_max = 100.0;
-uniform float frameTime = 0;
-uniform float globalTime = 0;
-
-float random (vec2 st) {
-    return fract(sin(dot(st.xy,
-                         vec2(12.9898,78.233)))*
-        43758.5453123);
-}
+#define PI 3.14159265358979
 
 struct Ray{
     vec3 origin;
@@ -50,8 +40,14 @@ struct Sphere{
     vec3 origin;
     vec3 color;
     float radius;
+    vec3 emission;
 };
 
+bool isEmissive(Sphere sphere)
+{
+    return any(greaterThan(sphere.emission, vec3(0)));
+}
+
 vec3 sphereNormal(Sphere sphere, float t, Ray ray)
 {
     return (rayAt(ray, t) - sphere.origin)/sphere.radius;
@@ -98,6 +94,100 @@ bool hitSphere(Sphere sphere, Ray ray, Interval interval, inout HitInfo hitinfo)
 }
 
 
+// Solid angle pdf of uniformly sampling the cone a sphere subtends from pos, zero from inside
+float sphereConePdf(Sphere sphere, vec3 pos)
+{
+    vec3 oc = sphere.origin - pos;
+    float dist2 = dot(oc, oc);
+    float r2 = sphere.radius * sphere.radius;
+    if (dist2 <= r2)
+    {
+        return 0.0;
+    }
+    float cos_theta_max = sqrt(1.0 - r2 / dist2);
+    return 1.0 / (2.0 * PI * (1.0 - cos_theta_max));
+}
+
+// Ray sheared so its direction becomes +z, shared by every triangle test of the ray
+struct RayShear{
+    ivec3 k;
+    vec3 s;
+};
+
+RayShear rayShear(Ray ray)
+{
+    vec3 d = ray.direction;
+    vec3 a = abs(d);
+    int kz = a.x > a.y ? (a.x > a.z ? 0 : 2) : (a.y > a.z ? 1 : 2);
+    int kx = (kz + 1) % 3;
+    int ky = (kx + 1) % 3;
+    // Keeps the winding of the triangles
+    if(d[kz] < 0.0){
+        int tmp = kx;
+        kx = ky;
+        ky = tmp;
+    }
+    return RayShear(ivec3(kx, ky, kz), vec3(d[kx] / d[kz], d[ky] / d[kz], 1.0 / d[kz]));
+}
+
+// Watertight test of Woop, Benthin and Wald like CpuTracer::hitTriangle, neighbouring triangles
+// evaluate the exact same edge functions so no ray slips through between them. Sets the geometric
+// normal facing the ray and the unnormalized barycentric weights of p0, p1 and p2.
+bool hitTriangle(vec3 p0, vec3 p1, vec3 p2, Ray ray, RayShear shear, Interval interval, inout HitInfo hitinfo,
+                 out vec3 weights)
+{
+    ivec3 k = shear.k;
+    precise vec3 a = p0 - ray.origin;
+    precise vec3 b = p1 - ray.origin;
+    precise vec3 c = p2 - ray.origin;
+    // precise keeps the compiler from fusing differently for the two triangles of an edge
+    precise float ax = a[k.x] - shear.s.x * a[k.z];
+    precise float ay = a[k.y] - shear.s.y * a[k.z];
+    precise float bx = b[k.x] - shear.s.x * b[k.z];
+    precise float by = b[k.y] - shear.s.y * b[k.z];
+    precise float cx = c[k.x] - shear.s.x * c[k.z];
+    precise float cy = c[k.y] - shear.s.y * c[k.z];
+
+    precise float u = cx * by - cy * bx;
+    precise float v = ax * cy - ay * cx;
+    precise float w = bx * ay - by * ax;
+    // Rays through an edge or vertex need the exact sign
+    if(u == 0.0 || v == 0.0 || w == 0.0){
+        u = float(double(cx) * double(by) - double(cy) * double(bx));
+        v = float(double(ax) * double(cy) - double(ay) * double(cx));
+        w = float(double(bx) * double(ay) - double(by) * double(ax));
+    }
+    if((u < 0.0 || v < 0.0 || w < 0.0) && (u > 0.0 || v > 0.0 || w > 0.0)){
+        return false;
+    }
+    float det = u + v + w;
+    if(det == 0.0){
+        return false;
+    }
+
+    float t = (u * shear.s.z * a[k.z] + v * shear.s.z * b[k.z] + w * shear.s.z * c[k.z]) / det;
+    if(!intervalSurrounds(interval, t)){
+        return false;
+    }
+    vec3 geometric = normalize(cross(p1 - p0, p2 - p0));
+    hitinfo.t = t;
+    hitinfo.pos = rayAt(ray, t);
+    hitinfo.front_face = dot(geometric, ray.direction) < 0.0;
+    hitinfo.normal = hitinfo.front_face ? geometric : -geometric;
+    weights = vec3(u, v, w);
+    return true;
+}
+
+// Slab test, inverse is one over the ray direction
+bool hitBounds(vec3 bounds_min, vec3 bounds_max, Ray ray, vec3 inverse, Interval interval)
+{
+    vec3 t0 = (bounds_min - ray.origin) * inverse;
+    vec3 t1 = (bounds_max - ray.origin) * inverse;
+    vec3 near = min(t0, t1);
+    vec3 far = max(t0, t1);
+    return max(max(near.x, near.y), max(near.z, interval.min)) <= min(min(far.x, far.y), min(far.z, interval.max));
+}
+
 bool hit(Sphere sphere, Ray ray, Interval interval, inout HitInfo hitinfo){
     return hitSphere(sphere,ray, interval ,hitinfo);
 }
@@ -0,0 +1,321 @@
+// Path tracer shared by quad.fsh, tile.csh and sweep.csh, the entry point fills params, pixel_uv and
+// pass_seed first
+
+struct TraceParams{
+    float window_width;
+    float window_height;
+    float viewport_height;
+    float focal_length;
+    float camera_z;
+    float t_min;
+    float t_max;
+    int max_ray_reflections;
+    int samples;
+    int light_sampling;
+    int numSpheres;
+    int numLights;
+    int numMeshes;
+    // Sphere whose color is replaced by color, -1 for none
+    int color_sphere;
+    vec3 color;
+};
+
+TraceParams params;
+vec2 pixel_uv;
+// Progressive passes need a new seed each, otherwise every pass repeats the same samples
+uint pass_seed = 0u;
+
+uint rng_state;
+
+uint hash(uint x){
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+// Seeded and stepped like CpuTracer::Rng: PCG, top 24 bits as a float in [0, 1)
+void seed_random(ivec2 pixel){
+    rng_state = hash(hash(uint(pixel.x) + 1u) ^ hash((uint(pixel.y) + 1u) * 7919u) ^ hash(pass_seed * 104729u + 1u));
+}
+
+float random_float(){
+    rng_state = rng_state * 747796405u + 2891336453u;
+    uint word = ((rng_state >> ((rng_state >> 28u) + 4u)) ^ rng_state) * 277803737u;
+    word = (word >> 22u) ^ word;
+    return float(word >> 8u) * (1.0 / 16777216.0);
+}
+
+float random_minmax(float min, float max){
+    return random_float()*(max-min)+min;
+}
+
+vec3 random_vec3(float min, float max){
+    return vec3(random_minmax(min, max), random_minmax(min, max), random_minmax(min, max));
+}
+
+vec3 random_on_hemisphere(const vec3 normal) {
+    vec3 on_unit_sphere = normalize(random_vec3(-1, 1));
+    if (dot(on_unit_sphere, normal) > 0.0) // In the same hemisphere as the normal
+        return on_unit_sphere;
+    else
+        return -on_unit_sphere;
+}
+
+mat3 onb(const vec3 n){
+    vec3 a = abs(n.x) > 0.9 ? vec3(0, 1, 0) : vec3(1, 0, 0);
+    vec3 t = normalize(cross(a, n));
+    return mat3(t, cross(n, t), n);
+}
+
+vec3 random_cosine_direction(const vec3 normal){
+    float r1 = random_float();
+    float r2 = random_float();
+    float phi = 2 * PI * r1;
+    float s = sqrt(r2);
+    return onb(normal) * vec3(cos(phi) * s, sin(phi) * s, sqrt(1 - r2));
+}
+
+// Uniform direction inside the cone the sphere subtends from pos
+vec3 random_to_sphere(const Sphere sphere, const vec3 pos){
+    vec3 oc = sphere.origin - pos;
+    float dist2 = dot(oc, oc);
+    float cos_theta_max = sqrt(1 - sphere.radius * sphere.radius / dist2);
+    float r1 = random_float();
+    float r2 = random_float();
+    float z = 1 + r2 * (cos_theta_max - 1);
+    float phi = 2 * PI * r1;
+    float s = sqrt(max(0.0, 1 - z * z));
+    return onb(oc / sqrt(dist2)) * vec3(cos(phi) * s, sin(phi) * s, z);
+}
+
+float power_heuristic(float a, float b){
+    return a * a / (a * a + b * b);
+}
+
+layout(std430, binding = 3) buffer sphereBuffer
+{
+    Sphere spheres[];
+};
+
+layout(std430, binding = 4) buffer lightBuffer
+{
+    int lights[];
+};
+
+// Packed by packMeshes in src/mesh.cpp
+struct MeshInfo{
+    vec3 bounds_min;
+    uint first_vertex;
+    vec3 bounds_extent;
+    uint first_triangle;
+    vec3 color;
+    uint triangle_count;
+    vec3 emission;
+};
+
+layout(std430, binding = 6) buffer meshBuffer
+{
+    MeshInfo meshes[];
+};
+
+// Three words per vertex: 21/21/22 bit position relative to the mesh bounds, octahedral normal
+layout(std430, binding = 7) buffer meshVertexBuffer
+{
+    uint meshVertices[];
+};
+
+layout(std430, binding = 8) buffer meshIndexBuffer
+{
+    uint meshIndices[];
+};
+
+vec3 unpackPosition(MeshInfo mesh, uint vertex){
+    uint w0 = meshVertices[vertex * 3];
+    uint w1 = meshVertices[vertex * 3 + 1];
+    uvec3 q = uvec3(w0 & 0x1FFFFFu, (w0 >> 21) | ((w1 & 0x3FFu) << 11), w1 >> 10);
+    // A vertex shared by two triangles has to decode to the same position for both, see hitTriangle
+    precise vec3 position = mesh.bounds_min + vec3(q) / vec3(2097151.0, 2097151.0, 4194303.0) * mesh.bounds_extent;
+    return position;
+}
+
+vec3 unpackNormal(uint vertex){
+    vec2 e = unpackSnorm2x16(meshVertices[vertex * 3 + 2]);
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
+bool hitMeshTriangle(MeshInfo mesh, uint triangle, Ray ray, RayShear shear, Interval interval, inout HitInfo hitinfo){
+    uint first = 3 * (mesh.first_triangle + triangle);
+    uvec3 v = mesh.first_vertex + uvec3(meshIndices[first], meshIndices[first + 1], meshIndices[first + 2]);
+    vec3 weights;
+    if(!hitTriangle(unpackPosition(mesh, v.x), unpackPosition(mesh, v.y), unpackPosition(mesh, v.z), ray, shear,
+                    interval, hitinfo, weights)){
+        return false;
+    }
+    // Interpolated normal on the side of the geometric one that faces the ray
+    vec3 shading = normalize(unpackNormal(v.x) * weights.x + unpackNormal(v.y) * weights.y +
+                             unpackNormal(v.z) * weights.z);
+    hitinfo.normal = dot(shading, hitinfo.normal) < 0.0 ? -shading : shading;
+    return true;
+}
+
+Sphere fetchSphere(int i){
+    Sphere sphere = spheres[i];
+    if(i == params.color_sphere){
+        sphere.color = params.color;
+    }
+    return sphere;
+}
+
+void getWorldHit(const Ray ray, inout HitInfo hitinfo, inout int index){
+    HitInfo lastHitInfo;
+    int lastIndex = -1;
+    lastHitInfo.t = params.t_max;
+
+    for (int i = 0; i < params.numSpheres; i++)
+    {
+        Sphere sphere = fetchSphere(i);
+        bool isHit = hit(sphere, ray, Interval(params.t_min, lastHitInfo.t), hitinfo);
+        if (isHit && hitinfo.t <= lastHitInfo.t)
+        {
+            lastHitInfo = hitinfo;
+            lastIndex = i;
+        }
+    }
+
+    // Meshes are numbered after the spheres
+    if(params.numMeshes > 0){
+        RayShear shear = rayShear(ray);
+        vec3 inverse = 1.0 / ray.direction;
+        for(int m = 0; m < params.numMeshes; m++){
+            MeshInfo mesh = meshes[m];
+            if(!hitBounds(mesh.bounds_min, mesh.bounds_min + mesh.bounds_extent, ray, inverse,
+                          Interval(params.t_min, lastHitInfo.t))){
+                continue;
+            }
+            for(uint i = 0u; i < mesh.triangle_count; i++){
+                if(hitMeshTriangle(mesh, i, ray, shear, Interval(params.t_min, lastHitInfo.t), hitinfo)){
+                    lastHitInfo = hitinfo;
+                    lastIndex = params.numSpheres + m;
+                }
+            }
+        }
+    }
+    hitinfo = lastHitInfo;
+    index = lastIndex;
+}
+
+void fetchMaterial(int index, out vec3 color, out vec3 emission){
+    if(index < params.numSpheres){
+        Sphere sphere = fetchSphere(index);
+        color = sphere.color;
+        emission = sphere.emission;
+        return;
+    }
+    MeshInfo mesh = meshes[index - params.numSpheres];
+    color = mesh.color;
+    emission = mesh.emission;
+}
+
+// Next event estimation towards one randomly chosen light, weighted against bsdf sampling
+vec3 sampleLight(const HitInfo surface){
+    int lightIdx = lights[min(int(random_float() * float(params.numLights)), params.numLights - 1)];
+    Sphere light = fetchSphere(lightIdx);
+    float lightPdf = sphereConePdf(light, surface.pos) / float(params.numLights);
+    if(lightPdf <= 0.0){
+        return vec3(0);
+    }
+    vec3 dir = random_to_sphere(light, surface.pos);
+    float cos_theta = dot(surface.normal, dir);
+    if(cos_theta <= 0.0){
+        return vec3(0);
+    }
+
+    HitInfo shadowHit;
+    int shadowIdx = -1;
+    getWorldHit(Ray(surface.pos, dir), shadowHit, shadowIdx);
+    if(shadowIdx != lightIdx){
+        return vec3(0);
+    }
+    float bsdfPdf = cos_theta / PI;
+    return light.emission * (cos_theta / PI) * power_heuristic(lightPdf, bsdfPdf) / lightPdf;
+}
+
+HitInfo hitinfo;
+Ray ray;
+
+vec3 rayColor(Ray iray)
+{
+    vec3 radiance = vec3(0);
+    vec3 throughput = vec3(1);
+    // pdf of the bsdf sample that produced ray, zero for camera rays
+    float bsdfPdf = 0.0;
+    bool useLights = params.light_sampling != 0 && params.numLights > 0;
+    ray = iray;
+    for(int step = 0; step < params.max_ray_reflections; step++){
+        int hitIdx = -1;
+
+        getWorldHit(ray, hitinfo, hitIdx);
+
+        if(hitIdx < 0){
+            float a = 0.5 * (ray.direction.y + 1.0);
+            vec3 tmp = (1.0 - a) * vec3(1.0, 1.0, 1.0) + a * vec3(0.5, 0.7, 1.0);
+            radiance += throughput * tmp;
+            break;
+        }
+
+        vec3 color, emission;
+        fetchMaterial(hitIdx, color, emission);
+        if(any(greaterThan(emission, vec3(0)))){
+            float weight = 1.0;
+            // Only spheres are light sampled, emissive meshes are found by bsdf samples alone
+            if(useLights && bsdfPdf > 0.0 && hitIdx < params.numSpheres){
+                float lightPdf = sphereConePdf(fetchSphere(hitIdx), ray.origin) / float(params.numLights);
+                weight = power_heuristic(bsdfPdf, lightPdf);
+            }
+            radiance += throughput * emission * weight;
+        }
+        if(step >= params.max_ray_reflections -1){
+            break;
+        }
+
+        if(useLights){
+            radiance += throughput * color * sampleLight(hitinfo);
+        }
+        vec3 dir = random_cosine_direction(hitinfo.normal);
+        bsdfPdf = max(dot(hitinfo.normal, dir), 0.0) / PI;
+        throughput *= color;
+        ray = Ray(hitinfo.pos, dir);
+    }
+    return radiance;
+}
+
+vec3 tracePixel()
+{
+    float aspect_ratio = params.window_width / params.window_height;
+    float viewport_width = params.viewport_height * aspect_ratio;
+    vec3 camera_center = vec3(0, 0, params.camera_z);
+
+    vec3 viewport_u = vec3(viewport_width, 0, 0);
+    vec3 viewport_v = vec3(0, -params.viewport_height, 0);
+    vec3 viewport_uv = viewport_u + viewport_v;
+    vec3 viewport_upleft = camera_center - vec3(0, 0, params.focal_length) - viewport_u / 2 - viewport_v / 2;
+    vec2 window_size = vec2(params.window_width, params.window_height);
+    seed_random(ivec2(pixel_uv * window_size));
+
+    vec3 accumulatedColor = vec3(0);
+
+    // Same rays as CpuTracer::pixelColor: u and v jittered independently over the whole pixel
+    for(int i = 0; i < params.samples; i++){
+        vec2 jitter = vec2(random_float(), random_float()) - 0.5;
+        vec3 pixel_center = vec3(pixel_uv + jitter / window_size, 0.0) * viewport_uv + viewport_upleft;
+        Ray r = Ray(camera_center, normalize(pixel_center - camera_center));
+        accumulatedColor += rayColor(r)/params.samples;
+    }
+    return accumulatedColor;
+}
@@ -0,0 +1,241 @@
+#include "capture.hpp"
+#include "image.hpp"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <spdlog/fmt/fmt.h>
+#include <spdlog/spdlog.h>
+
+FrameCapture::FrameCapture(std::string const &directory, std::string const &extension, uint32_t ringSize,
+                           uint32_t workerCount)
+    : directory(directory), extension(extension)
+{
+    std::filesystem::create_directories(directory);
+    for (uint32_t i = 0; i < ringSize; i++)
+    {
+        slots.push_back(std::make_unique<Slot>());
+    }
+    if (workerCount == 0)
+    {
+        workerCount = std::clamp(std::thread::hardware_concurrency() / 2, 1u, 4u);
+    }
+    for (uint32_t i = 0; i < workerCount; i++)
+    {
+        workers.emplace_back(&FrameCapture::work, this);
+    }
+    spdlog::info("Recording {} frames to {} with {} buffers and {} encoders", extension, directory, ringSize,
+                 workerCount);
+}
+
+FrameCapture::~FrameCapture()
+{
+    for (auto &slot : slots)
+    {
+        if (slot->state == Pending)
+        {
+            ez::clientWaitSync(slot->fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+            handOff(*slot);
+        }
+    }
+    for (auto &slot : slots)
+    {
+        slot->state.wait(Mapped);
+        recycle(*slot);
+    }
+    {
+        std::lock_guard lock(jobsMutex);
+        stopping = true;
+    }
+    jobsCondition.notify_all();
+    for (auto &t : workers)
+    {
+        t.join();
+    }
+    spdlog::info("Recorded {} frames, {} stalls, capture took {:.3f} ms on average and {:.3f} ms at most",
+                 written.load(), stalls, getAverageCaptureMs(), maxCaptureMs);
+    if (getAverageCaptureMs() > 1.0)
+    {
+        spdlog::warn("Capture averaged more than the 1 ms per frame budget");
+    }
+}
+
+void FrameCapture::handOff(Slot &slot)
+{
+    ez::deleteSync(slot.fence);
+    slot.fence = nullptr;
+    slot.data = static_cast<uint8_t const *>(slot.pbo.map());
+    ez::bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    slot.state = Mapped;
+    {
+        std::lock_guard lock(jobsMutex);
+        jobs.push_back(&slot);
+    }
+    jobsCondition.notify_one();
+}
+
+void FrameCapture::recycle(Slot &slot)
+{
+    if (slot.state == Released)
+    {
+        slot.pbo.unmap();
+        ez::bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        slot.data = nullptr;
+        slot.state = Free;
+    }
+}
+
+void FrameCapture::poll()
+{
+    for (auto &slot : slots)
+    {
+        recycle(*slot);
+    }
+    // Walk the ring from the oldest frame so images are handed off in order
+    for (uint32_t i = 0; i < slots.size(); i++)
+    {
+        Slot &slot = *slots[(head + i) % slots.size()];
+        if (slot.state == Pending)
+        {
+            GLenum status = ez::clientWaitSync(slot.fence, 0, 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            {
+                break;
+            }
+            handOff(slot);
+        }
+    }
+}
+
+FrameCapture::Slot &FrameCapture::acquire(int32_t width, int32_t height, bool floats)
+{
+    poll();
+
+    Slot &slot = *slots[head];
+    if (slot.state != Free)
+    {
+        // Ring is full, wait for the oldest frame instead of growing the queue
+        stalls++;
+        if (slot.state == Pending)
+        {
+            ez::clientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+            handOff(slot);
+        }
+        slot.state.wait(Mapped);
+        recycle(slot);
+    }
+
+    size_t size = size_t(width) * height * 4 * (floats ? sizeof(float) : 1);
+    if (slot.pbo.getSize() != size)
+    {
+        slot.pbo.allocate(size);
+    }
+    slot.floats = floats;
+    slot.width = width;
+    slot.height = height;
+    slot.frame = frameCounter++;
+    slot.pbo.bind();
+    return slot;
+}
+
+void FrameCapture::capture(int32_t width, int32_t height)
+{
+    auto start = std::chrono::steady_clock::now();
+    Slot &slot = acquire(width, height, false);
+    ez::readPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    submit(slot, start);
+}
+
+void FrameCapture::capture(ez::Texture &texture)
+{
+    auto start = std::chrono::steady_clock::now();
+    Slot &slot = acquire(texture.getWidth(), texture.getHeight(), true);
+    ez::memoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+    texture.readToPixelBuffer();
+    submit(slot, start);
+}
+
+bool FrameCapture::needsFloatSource()
+{
+    return extension == "exr";
+}
+
+void FrameCapture::submit(Slot &slot, std::chrono::steady_clock::time_point start)
+{
+    ez::bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    slot.fence = ez::fenceSync();
+    slot.state = Pending;
+    head = (head + 1) % slots.size();
+
+    lastCaptureMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    totalCaptureMs += lastCaptureMs;
+    maxCaptureMs = std::max(maxCaptureMs, lastCaptureMs);
+}
+
+void FrameCapture::work()
+{
+    while (true)
+    {
+        Slot *slot;
+        {
+            std::unique_lock lock(jobsMutex);
+            jobsCondition.wait(lock, [this]() { return stopping || !jobs.empty(); });
+            if (jobs.empty())
+            {
+                return;
+            }
+            slot = jobs.front();
+            jobs.pop_front();
+        }
+
+        Image image(slot->width, slot->height);
+        if (slot->floats)
+        {
+            float const *pixels = reinterpret_cast<float const *>(slot->data);
+            for (size_t i = 0; i < image.pixels.size(); i++)
+            {
+                image.pixels[i] = glm::vec3(pixels[i * 4], pixels[i * 4 + 1], pixels[i * 4 + 2]);
+            }
+        }
+        else
+        {
+            // GL rows start at the bottom, images at the top
+            for (int32_t y = 0; y < image.height; y++)
+            {
+                uint8_t const *row = slot->data + size_t(image.height - 1 - y) * image.width * 4;
+                for (int32_t x = 0; x < image.width; x++)
+                {
+                    image.at(x, y) = glm::vec3(row[x * 4], row[x * 4 + 1], row[x * 4 + 2]) / 255.0f;
+                }
+            }
+        }
+        uint64_t frame = slot->frame;
+        slot->state = Released;
+        slot->state.notify_all();
+
+        std::string path = fmt::format("{}/frame_{:05d}.{}", directory, frame, extension);
+        if (writeImage(path, image))
+        {
+            written++;
+        }
+    }
+}
+
+double FrameCapture::getLastCaptureMs()
+{
+    return lastCaptureMs;
+}
+
+double FrameCapture::getAverageCaptureMs()
+{
+    return frameCounter ? totalCaptureMs / frameCounter : 0;
+}
+
+uint64_t FrameCapture::getFramesWritten()
+{
+    return written;
+}
+
+uint64_t FrameCapture::getStalls()
+{
+    return stalls;
+}
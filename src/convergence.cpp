@@ -0,0 +1,208 @@
+#include "convergence.hpp"
+#include "cpu_tracer.hpp"
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <nlohmann/json.hpp>
+#include <spdlog/spdlog.h>
+
+using Clock = std::chrono::steady_clock;
+
+// Passes use seeds counting up from 1, the reference must not share any of them
+static constexpr uint32_t referenceSeed = 0x9e3779b9u;
+
+// FNV-1a, only has to tell cached references apart
+template <typename T> static void hash(uint64_t &h, T const &value)
+{
+    uint8_t const *bytes = reinterpret_cast<uint8_t const *>(&value);
+    for (size_t i = 0; i < sizeof(T); i++)
+    {
+        h = (h ^ bytes[i]) * 0x100000001b3ull;
+    }
+}
+
+// Everything the reference image depends on, field by field to skip padding
+static uint64_t referenceHash(std::vector<Sphere> const &spheres, MeshBuffers const &meshes,
+                              TraceSettings const &settings, int32_t width, int32_t height)
+{
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (auto value : {settings.viewport_size, settings.focal_length, settings.camera_z, settings.t_min,
+                       settings.t_max})
+    {
+        hash(h, value);
+    }
+    for (auto value : {settings.max_ray_reflections, settings.samples, width, height})
+    {
+        hash(h, value);
+    }
+    hash(h, settings.light_sampling);
+    hash(h, referenceSeed);
+    hash(h, CpuTracer::version);
+    for (Sphere const &s : spheres)
+    {
+        for (auto value : {s.origin, s.color, s.emission})
+        {
+            hash(h, value.x);
+            hash(h, value.y);
+            hash(h, value.z);
+        }
+        hash(h, s.radius);
+    }
+    for (MeshInfo const &mesh : meshes.meshes)
+    {
+        for (auto value : {mesh.bounds_min, mesh.bounds_extent, mesh.color, mesh.emission})
+        {
+            hash(h, value.x);
+            hash(h, value.y);
+            hash(h, value.z);
+        }
+        hash(h, mesh.first_vertex);
+        hash(h, mesh.first_triangle);
+        hash(h, mesh.triangle_count);
+    }
+    for (uint32_t word : meshes.vertices)
+    {
+        hash(h, word);
+    }
+    for (uint32_t index : meshes.indices)
+    {
+        hash(h, index);
+    }
+    return h;
+}
+
+bool loadReference(std::string const &scene, std::vector<Sphere> const &spheres, MeshBuffers const &meshes,
+                   TraceSettings const &settings, int32_t width, int32_t height, ConvergenceOptions const &options,
+                   Image &reference)
+{
+    // Light sampling and the sample count only change the noise, not the image the tracer converges to
+    TraceSettings referenceSettings = settings;
+    referenceSettings.samples = options.referenceSamples;
+    referenceSettings.light_sampling = true;
+    std::string path =
+        fmt::format("{}/{}_{}x{}_r{}_{}spp_{:016x}.pfm", options.referenceDirectory, scene, width, height,
+                    settings.max_ray_reflections, options.referenceSamples,
+                    referenceHash(spheres, meshes, referenceSettings, width, height));
+    if (std::filesystem::exists(path))
+    {
+        return readPFM(path, reference);
+    }
+
+    spdlog::info("Rendering the {} reference with {} samples per pixel", scene, options.referenceSamples);
+    reference = Image(width, height);
+    CpuTracer(spheres, meshes, referenceSettings).render(reference, referenceSeed);
+
+    std::filesystem::create_directories(options.referenceDirectory);
+    return writePFM(path, reference);
+}
+
+void imageError(Image const &image, Image const &reference, double &rmse, double &relMse)
+{
+    double squared = 0, relative = 0;
+    for (size_t i = 0; i < image.pixels.size(); i++)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            double ref = reference.pixels[i][c];
+            double error = image.pixels[i][c] - ref;
+            squared += error * error;
+            relative += error * error / (ref * ref + 1e-2);
+        }
+    }
+    double count = 3.0 * image.pixels.size();
+    rmse = std::sqrt(squared / count);
+    relMse = relative / count;
+}
+
+PassRenderer cpuPassRenderer(CpuTracer const &tracer, int32_t width, int32_t height)
+{
+    auto pass = std::make_shared<Image>(width, height);
+    auto sum = std::make_shared<Image>(width, height);
+    auto passes = std::make_shared<uint32_t>(0);
+    PassRenderer renderer;
+    renderer.render = [&tracer, pass, sum, passes](uint32_t seed) {
+        tracer.render(*pass, seed);
+        for (size_t i = 0; i < sum->pixels.size(); i++)
+        {
+            sum->pixels[i] += pass->pixels[i];
+        }
+        (*passes)++;
+    };
+    renderer.estimate = [sum, passes](Image &image) {
+        image = Image(sum->width, sum->height);
+        for (size_t i = 0; i < sum->pixels.size(); i++)
+        {
+            image.pixels[i] = sum->pixels[i] / float(*passes);
+        }
+    };
+    return renderer;
+}
+
+std::vector<ConvergenceSample> measureConvergence(Image const &reference, uint32_t samplesPerPass,
+                                                  PassRenderer const &renderer, ConvergenceOptions const &options)
+{
+    std::vector<ConvergenceSample> curve;
+    Image estimate;
+    double seconds = 0;
+    double nextSample = options.intervalSeconds;
+
+    for (uint32_t passes = 1; seconds < options.durationSeconds; passes++)
+    {
+        auto start = Clock::now();
+        renderer.render(passes);
+        seconds += std::chrono::duration<double>(Clock::now() - start).count();
+
+        if (seconds < nextSample && seconds < options.durationSeconds)
+        {
+            continue;
+        }
+        // A pass can take longer than an interval, record once and skip the intervals it covered
+        while (nextSample <= seconds)
+        {
+            nextSample += options.intervalSeconds;
+        }
+
+        renderer.estimate(estimate);
+        ConvergenceSample sample{seconds, passes, passes * samplesPerPass, 0, 0};
+        imageError(estimate, reference, sample.rmse, sample.relMse);
+        spdlog::debug("{:.2f} s, {} spp, rmse {:.5f}, relMSE {:.5f}", sample.seconds, sample.samples, sample.rmse,
+                      sample.relMse);
+        curve.push_back(sample);
+    }
+    return curve;
+}
+
+bool writeConvergence(std::string const &path, std::string const &scene, std::string const &tracer,
+                      TraceSettings const &settings, std::vector<ConvergenceSample> const &curve)
+{
+    std::ofstream csv(path + ".csv");
+    std::ofstream json(path + ".json");
+    if (not csv || not json)
+    {
+        spdlog::error("Unable to open file {}.csv/.json", path);
+        return false;
+    }
+
+    csv << "seconds,passes,samples,rmse,relmse\n";
+    nlohmann::json samples = nlohmann::json::array();
+    for (ConvergenceSample const &s : curve)
+    {
+        csv << fmt::format("{:.4f},{},{},{:.6g},{:.6g}\n", s.seconds, s.passes, s.samples, s.rmse, s.relMse);
+        samples.push_back({{"seconds", s.seconds},
+                           {"passes", s.passes},
+                           {"samples", s.samples},
+                           {"rmse", s.rmse},
+                           {"relmse", s.relMse}});
+    }
+
+    nlohmann::json document = {{"scene", scene},
+                               {"tracer", tracer},
+                               {"max_ray_reflections", settings.max_ray_reflections},
+                               {"samples_per_pass", settings.samples},
+                               {"light_sampling", settings.light_sampling},
+                               {"curve", samples}};
+    json << document.dump(2) << "\n";
+    return csv.good() && json.good();
+}
@@ -0,0 +1,454 @@
+#include "cpu_tracer.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+static constexpr float PI = 3.14159265358979f;
+
+static uint32_t hash(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+float CpuTracer::Rng::next()
+{
+    // PCG step, top 24 bits as a float in [0, 1)
+    state = state * 747796405u + 2891336453u;
+    uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    word = (word >> 22u) ^ word;
+    return (word >> 8) * (1.0f / 16777216.0f);
+}
+
+static void onb(glm::vec3 const &n, glm::vec3 &t, glm::vec3 &b)
+{
+    glm::vec3 a = std::fabs(n.x) > 0.9f ? glm::vec3(0, 1, 0) : glm::vec3(1, 0, 0);
+    t = glm::normalize(glm::cross(a, n));
+    b = glm::cross(n, t);
+}
+
+static glm::vec3 randomCosineDirection(glm::vec3 const &normal, float r1, float r2)
+{
+    glm::vec3 t, b;
+    onb(normal, t, b);
+    float phi = 2 * PI * r1;
+    float s = std::sqrt(r2);
+    return t * (std::cos(phi) * s) + b * (std::sin(phi) * s) + normal * std::sqrt(1 - r2);
+}
+
+// Solid angle pdf of uniformly sampling the cone a sphere subtends from pos, zero from inside
+static float sphereConePdf(Sphere const &sphere, glm::vec3 const &pos)
+{
+    glm::vec3 oc = sphere.origin - pos;
+    float dist2 = glm::dot(oc, oc);
+    float r2 = sphere.radius * sphere.radius;
+    if (dist2 <= r2)
+    {
+        return 0;
+    }
+    float cos_theta_max = std::sqrt(1 - r2 / dist2);
+    return 1 / (2 * PI * (1 - cos_theta_max));
+}
+
+static glm::vec3 randomToSphere(Sphere const &sphere, glm::vec3 const &pos, float r1, float r2)
+{
+    glm::vec3 oc = sphere.origin - pos;
+    float dist2 = glm::dot(oc, oc);
+    float cos_theta_max = std::sqrt(1 - sphere.radius * sphere.radius / dist2);
+    float z = 1 + r2 * (cos_theta_max - 1);
+    float phi = 2 * PI * r1;
+    float s = std::sqrt(std::max(0.0f, 1 - z * z));
+
+    glm::vec3 w = oc / std::sqrt(dist2);
+    glm::vec3 t, b;
+    onb(w, t, b);
+    return t * (std::cos(phi) * s) + b * (std::sin(phi) * s) + w * z;
+}
+
+static float powerHeuristic(float a, float b)
+{
+    return a * a / (a * a + b * b);
+}
+
+CpuTracer::CpuTracer(std::vector<Sphere> const &spheres, TraceSettings const &settings)
+    : CpuTracer(spheres, MeshBuffers(), settings)
+{
+}
+
+CpuTracer::CpuTracer(std::vector<Sphere> const &spheres, MeshBuffers const &meshes, TraceSettings const &settings)
+    : spheres(spheres), lights(lightIndices(spheres)), meshes(meshes), settings(settings)
+{
+    for (MeshInfo const &mesh : meshes.meshes)
+    {
+        size_t end = meshes.vertices.size() / vertexWords;
+        if (&mesh != &meshes.meshes.back())
+        {
+            end = (&mesh + 1)->first_vertex;
+        }
+        for (size_t i = mesh.first_vertex; i < end; i++)
+        {
+            positions.push_back(unpackPosition(mesh, &meshes.vertices[i * vertexWords]));
+            normals.push_back(unpackNormal(meshes.vertices[i * vertexWords + 2]));
+        }
+    }
+}
+
+void CpuTracer::setThreads(uint32_t threads)
+{
+    this->threads = threads;
+}
+
+bool CpuTracer::hitSphere(Sphere const &sphere, Ray const &ray, float t_min, float t_max, HitInfo &hitinfo) const
+{
+    glm::vec3 oc = sphere.origin - ray.origin;
+    float a = 1 / glm::dot(ray.direction, ray.direction);
+
+    float p = glm::dot(ray.direction, oc) * a;
+    float q = (glm::dot(oc, oc) - sphere.radius * sphere.radius) * a;
+    float discriminant = (p * p) - q;
+    if (discriminant <= 0)
+    {
+        return false;
+    }
+
+    float root = std::sqrt(discriminant);
+    float t = p - root;
+    if (!(t_min < t && t < t_max))
+    {
+        t = p + root;
+        if (!(t_min < t && t < t_max))
+        {
+            return false;
+        }
+    }
+    hitinfo.t = t;
+    hitinfo.pos = ray.origin + ray.direction * t;
+    hitinfo.normal = (hitinfo.pos - sphere.origin) / sphere.radius;
+    hitinfo.front_face = glm::dot(hitinfo.normal, ray.direction) < 0;
+    if (!hitinfo.front_face)
+    {
+        hitinfo.normal = -hitinfo.normal;
+    }
+    return true;
+}
+
+CpuTracer::RayShear CpuTracer::rayShear(Ray const &ray)
+{
+    glm::vec3 d = ray.direction;
+    glm::vec3 a = glm::abs(d);
+    int kz = a.x > a.y ? (a.x > a.z ? 0 : 2) : (a.y > a.z ? 1 : 2);
+    int kx = (kz + 1) % 3;
+    int ky = (kx + 1) % 3;
+    // Keeps the winding of the triangles
+    if (d[kz] < 0)
+    {
+        std::swap(kx, ky);
+    }
+    return RayShear{kx, ky, kz, glm::vec3(d[kx] / d[kz], d[ky] / d[kz], 1 / d[kz])};
+}
+
+// Watertight test of Woop, Benthin and Wald: neighbouring triangles evaluate the exact same edge
+// functions for their shared edge, so no ray slips through between them
+bool CpuTracer::hitTriangle(MeshInfo const &mesh, uint32_t triangle, Ray const &ray, RayShear const &shear,
+                            float t_min, float t_max, HitInfo &hitinfo) const
+{
+    uint32_t const *index = &meshes.indices[3 * (mesh.first_triangle + triangle)];
+    uint32_t i0 = mesh.first_vertex + index[0];
+    uint32_t i1 = mesh.first_vertex + index[1];
+    uint32_t i2 = mesh.first_vertex + index[2];
+    glm::vec3 a = positions[i0] - ray.origin;
+    glm::vec3 b = positions[i1] - ray.origin;
+    glm::vec3 c = positions[i2] - ray.origin;
+
+    float ax = a[shear.kx] - shear.s.x * a[shear.kz];
+    float ay = a[shear.ky] - shear.s.y * a[shear.kz];
+    float bx = b[shear.kx] - shear.s.x * b[shear.kz];
+    float by = b[shear.ky] - shear.s.y * b[shear.kz];
+    float cx = c[shear.kx] - shear.s.x * c[shear.kz];
+    float cy = c[shear.ky] - shear.s.y * c[shear.kz];
+
+    float u = cx * by - cy * bx;
+    float v = ax * cy - ay * cx;
+    float w = bx * ay - by * ax;
+    // Rays through an edge or vertex need the exact sign
+    if (u == 0 || v == 0 || w == 0)
+    {
+        u = double(cx) * by - double(cy) * bx;
+        v = double(ax) * cy - double(ay) * cx;
+        w = double(bx) * ay - double(by) * ax;
+    }
+    if ((u < 0 || v < 0 || w < 0) && (u > 0 || v > 0 || w > 0))
+    {
+        return false;
+    }
+    float det = u + v + w;
+    if (det == 0)
+    {
+        return false;
+    }
+
+    float t = (u * shear.s.z * a[shear.kz] + v * shear.s.z * b[shear.kz] + w * shear.s.z * c[shear.kz]) / det;
+    if (!(t_min < t && t < t_max))
+    {
+        return false;
+    }
+
+    glm::vec3 geometric = glm::cross(positions[i1] - positions[i0], positions[i2] - positions[i0]);
+    glm::vec3 shading = glm::normalize(normals[i0] * u + normals[i1] * v + normals[i2] * w);
+    if (glm::dot(shading, geometric) < 0)
+    {
+        shading = -shading;
+    }
+    hitinfo.t = t;
+    hitinfo.pos = ray.origin + ray.direction * t;
+    hitinfo.front_face = glm::dot(geometric, ray.direction) < 0;
+    hitinfo.normal = hitinfo.front_face ? shading : -shading;
+    return true;
+}
+
+// Slab test against the bounds of a mesh
+static bool hitBounds(MeshInfo const &mesh, glm::vec3 const &origin, glm::vec3 const &inverse, float t_min,
+                      float t_max)
+{
+    for (int axis = 0; axis < 3; axis++)
+    {
+        float t0 = (mesh.bounds_min[axis] - origin[axis]) * inverse[axis];
+        float t1 = (mesh.bounds_min[axis] + mesh.bounds_extent[axis] - origin[axis]) * inverse[axis];
+        t_min = std::max(t_min, std::min(t0, t1));
+        t_max = std::min(t_max, std::max(t0, t1));
+    }
+    return t_min <= t_max;
+}
+
+int32_t CpuTracer::getWorldHit(Ray const &ray, HitInfo &hitinfo) const
+{
+    int32_t index = -1;
+    float closest = settings.t_max;
+    for (uint32_t i = 0; i < spheres.size(); i++)
+    {
+        HitInfo candidate;
+        if (hitSphere(spheres[i], ray, settings.t_min, closest, candidate))
+        {
+            closest = candidate.t;
+            hitinfo = candidate;
+            index = i;
+        }
+    }
+
+    if (meshes.meshes.empty())
+    {
+        return index;
+    }
+    RayShear shear = rayShear(ray);
+    glm::vec3 inverse(1 / ray.direction.x, 1 / ray.direction.y, 1 / ray.direction.z);
+    for (uint32_t m = 0; m < meshes.meshes.size(); m++)
+    {
+        MeshInfo const &mesh = meshes.meshes[m];
+        if (!hitBounds(mesh, ray.origin, inverse, settings.t_min, closest))
+        {
+            continue;
+        }
+        for (uint32_t i = 0; i < mesh.triangle_count; i++)
+        {
+            HitInfo candidate;
+            if (hitTriangle(mesh, i, ray, shear, settings.t_min, closest, candidate))
+            {
+                closest = candidate.t;
+                hitinfo = candidate;
+                index = spheres.size() + m;
+            }
+        }
+    }
+    return index;
+}
+
+CpuTracer::Material CpuTracer::material(int32_t index) const
+{
+    if (index < int32_t(spheres.size()))
+    {
+        return Material{spheres[index].color, spheres[index].emission};
+    }
+    MeshInfo const &mesh = meshes.meshes[index - spheres.size()];
+    return Material{mesh.color, mesh.emission};
+}
+
+glm::vec3 CpuTracer::sampleLight(HitInfo const &hitinfo, Rng &rng) const
+{
+    uint32_t choice = std::min<uint32_t>(rng.next() * lights.size(), lights.size() - 1);
+    int32_t lightIdx = lights[choice];
+    Sphere const &light = spheres[lightIdx];
+
+    float lightPdf = sphereConePdf(light, hitinfo.pos) / lights.size();
+    float r1 = rng.next();
+    float r2 = rng.next();
+    if (lightPdf <= 0)
+    {
+        return glm::vec3(0);
+    }
+    glm::vec3 dir = randomToSphere(light, hitinfo.pos, r1, r2);
+    float cos_theta = glm::dot(hitinfo.normal, dir);
+    if (cos_theta <= 0)
+    {
+        return glm::vec3(0);
+    }
+
+    HitInfo shadow;
+    if (getWorldHit(Ray{hitinfo.pos, dir}, shadow) != lightIdx)
+    {
+        return glm::vec3(0);
+    }
+    float bsdfPdf = cos_theta / PI;
+    return light.emission * (cos_theta / PI) * (powerHeuristic(lightPdf, bsdfPdf) / lightPdf);
+}
+
+glm::vec3 CpuTracer::rayColor(Ray ray, Rng &rng) const
+{
+    glm::vec3 radiance(0);
+    glm::vec3 throughput(1);
+    // Pdf of the bsdf sample that produced ray, zero for camera rays
+    float bsdfPdf = 0;
+    bool useLights = settings.light_sampling && !lights.empty();
+
+    for (int step = 0; step < settings.max_ray_reflections; step++)
+    {
+        HitInfo hitinfo;
+        int32_t hitIdx = getWorldHit(ray, hitinfo);
+        if (hitIdx < 0)
+        {
+            float a = 0.5f * (ray.direction.y + 1.0f);
+            radiance += throughput * ((1.0f - a) * glm::vec3(1.0, 1.0, 1.0) + a * glm::vec3(0.5, 0.7, 1.0));
+            break;
+        }
+
+        Material hit = material(hitIdx);
+        if (hit.emission.x > 0 || hit.emission.y > 0 || hit.emission.z > 0)
+        {
+            float weight = 1;
+            // Only spheres are light sampled, emissive meshes are found by bsdf samples alone
+            if (useLights && bsdfPdf > 0 && hitIdx < int32_t(spheres.size()))
+            {
+                weight = powerHeuristic(bsdfPdf, sphereConePdf(spheres[hitIdx], ray.origin) / lights.size());
+            }
+            radiance += throughput * hit.emission * weight;
+        }
+        if (step >= settings.max_ray_reflections - 1)
+        {
+            break;
+        }
+
+        if (useLights)
+        {
+            radiance += throughput * hit.color * sampleLight(hitinfo, rng);
+        }
+        float r1 = rng.next();
+        float r2 = rng.next();
+        glm::vec3 dir = randomCosineDirection(hitinfo.normal, r1, r2);
+        bsdfPdf = std::max(0.0f, glm::dot(hitinfo.normal, dir)) / PI;
+        throughput *= hit.color;
+        ray = Ray{hitinfo.pos, dir};
+    }
+    return radiance;
+}
+
+glm::vec3 CpuTracer::pixelColor(int32_t x, int32_t y, int32_t width, int32_t height, uint32_t seed) const
+{
+    float aspect_ratio = float(width) / height;
+    float viewport_height = settings.viewport_size;
+    float viewport_width = viewport_height * aspect_ratio;
+    glm::vec3 camera_center(0, 0, settings.camera_z);
+    glm::vec3 viewport_uv(viewport_width, -viewport_height, 0);
+    glm::vec3 viewport_upleft =
+        camera_center - glm::vec3(0, 0, settings.focal_length) - glm::vec3(viewport_width, -viewport_height, 0) / 2.0f;
+
+    Rng rng{hash(hash(x + 1) ^ hash((y + 1) * 7919) ^ hash(seed * 104729 + 1))};
+    glm::vec3 color(0);
+    // pixel_uv + (jitter - 0.5) / size in tracePixel of shaders/trace.glsl, with pixel_uv at the pixel centre
+    for (int i = 0; i < settings.samples; i++)
+    {
+        float u = (x + rng.next()) / width;
+        float v = (y + rng.next()) / height;
+        glm::vec3 pixel_center = glm::vec3(u, v, 0) * viewport_uv + viewport_upleft;
+        Ray ray{camera_center, glm::normalize(pixel_center - camera_center)};
+        color += rayColor(ray, rng);
+    }
+    return color / float(settings.samples);
+}
+
+void CpuTracer::render(Image &image, Tile const &tile, uint32_t seed) const
+{
+    std::atomic<int32_t> nextRow = tile.y;
+    auto worker = [&]() {
+        for (int32_t y = nextRow++; y < tile.y + tile.height; y = nextRow++)
+        {
+            for (int32_t x = tile.x; x < tile.x + tile.width; x++)
+            {
+                image.at(x, y) = pixelColor(x, y, image.width, image.height, seed);
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    uint32_t count = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+    for (uint32_t i = 0; i < count; i++)
+    {
+        pool.emplace_back(worker);
+    }
+    for (auto &t : pool)
+    {
+        t.join();
+    }
+}
+
+void CpuTracer::render(Image &image, uint32_t seed) const
+{
+    render(image, Tile{0, 0, image.width, image.height}, seed);
+}
+
+double CpuTracer::intersectionThroughput(int32_t width, int32_t height) const
+{
+    float aspect_ratio = float(width) / height;
+    float viewport_height = settings.viewport_size;
+    float viewport_width = viewport_height * aspect_ratio;
+    glm::vec3 camera_center(0, 0, settings.camera_z);
+    glm::vec3 viewport_upleft =
+        camera_center - glm::vec3(0, 0, settings.focal_length) - glm::vec3(viewport_width, -viewport_height, 0) / 2.0f;
+
+    std::atomic<int32_t> nextRow = 0;
+    // Summed so the queries can't be optimised away
+    std::atomic<uint32_t> hits = 0;
+    auto worker = [&]() {
+        uint32_t rowHits = 0;
+        for (int32_t y = nextRow++; y < height; y = nextRow++)
+        {
+            for (int32_t x = 0; x < width; x++)
+            {
+                glm::vec3 pixel =
+                    glm::vec3((x + 0.5f) / width * viewport_width, -(y + 0.5f) / height * viewport_height, 0) +
+                    viewport_upleft;
+                HitInfo hitinfo;
+                rowHits += getWorldHit(Ray{camera_center, glm::normalize(pixel - camera_center)}, hitinfo) >= 0;
+            }
+        }
+        hits += rowHits;
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> pool;
+    uint32_t count = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+    for (uint32_t i = 0; i < count; i++)
+    {
+        pool.emplace_back(worker);
+    }
+    for (auto &t : pool)
+    {
+        t.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return double(width) * height / seconds;
+}
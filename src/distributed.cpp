@@ -0,0 +1,788 @@
+#include "distributed.hpp"
+#include "cpu_tracer.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <spdlog/spdlog.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+using Clock = std::chrono::steady_clock;
+
+enum MessageType : uint32_t
+{
+    SceneMessage = 1,
+    TileMessage,
+    ResultMessage,
+    ShutdownMessage,
+};
+
+// Upper bound of a scene message, a peer announcing more is dropped before anything is allocated
+static constexpr uint32_t maxSceneBytes = 1u << 30;
+
+// Values are copied as they are in memory, coordinator and workers have to share endianness
+class Writer
+{
+  public:
+    std::vector<uint8_t> data;
+
+    Writer(MessageType type)
+    {
+        put<uint32_t>(type);
+        put<uint32_t>(0);
+    }
+
+    template <typename T> void put(T value)
+    {
+        uint8_t bytes[sizeof(T)];
+        std::memcpy(bytes, &value, sizeof(T));
+        data.insert(data.end(), bytes, bytes + sizeof(T));
+    }
+
+    void putVec3(glm::vec3 const &v)
+    {
+        put(v.x);
+        put(v.y);
+        put(v.z);
+    }
+
+    template <typename T> void putArray(std::vector<T> const &values)
+    {
+        put<uint32_t>(values.size());
+        uint8_t const *bytes = reinterpret_cast<uint8_t const *>(values.data());
+        data.insert(data.end(), bytes, bytes + values.size() * sizeof(T));
+    }
+
+    // Patches the payload size into the header
+    std::vector<uint8_t> const &finish()
+    {
+        uint32_t size = data.size() - 8;
+        std::memcpy(data.data() + 4, &size, sizeof(size));
+        return data;
+    }
+};
+
+class Reader
+{
+  private:
+    uint8_t const *data;
+    size_t size;
+    size_t offset = 0;
+    bool valid = true;
+
+  public:
+    Reader(std::vector<uint8_t> const &payload) : data(payload.data()), size(payload.size())
+    {
+    }
+
+    template <typename T> T get()
+    {
+        T value{};
+        if (offset + sizeof(T) > size)
+        {
+            valid = false;
+            return value;
+        }
+        std::memcpy(&value, data + offset, sizeof(T));
+        offset += sizeof(T);
+        return value;
+    }
+
+    glm::vec3 getVec3()
+    {
+        float x = get<float>();
+        float y = get<float>();
+        float z = get<float>();
+        return glm::vec3(x, y, z);
+    }
+
+    template <typename T> void getArray(std::vector<T> &values)
+    {
+        uint32_t count = get<uint32_t>();
+        if (!valid || count > (size - offset) / sizeof(T))
+        {
+            valid = false;
+            return;
+        }
+        values.resize(count);
+        std::memcpy(values.data(), data + offset, count * sizeof(T));
+        offset += count * sizeof(T);
+    }
+
+    bool ok()
+    {
+        return valid;
+    }
+};
+
+static std::vector<uint8_t> sceneMessage(std::vector<Sphere> const &spheres, MeshBuffers const &meshes,
+                                         TraceSettings const &settings, int32_t width, int32_t height)
+{
+    Writer w(SceneMessage);
+    w.put(width);
+    w.put(height);
+    w.put(settings.viewport_size);
+    w.put(settings.focal_length);
+    w.put(settings.camera_z);
+    w.put(settings.t_min);
+    w.put(settings.t_max);
+    w.put<int32_t>(settings.max_ray_reflections);
+    w.put<int32_t>(settings.samples);
+    w.put<uint8_t>(settings.light_sampling);
+    w.put<uint32_t>(spheres.size());
+    for (Sphere const &s : spheres)
+    {
+        w.putVec3(s.origin);
+        w.putVec3(s.color);
+        w.put(s.radius);
+        w.putVec3(s.emission);
+    }
+    w.putArray(meshes.meshes);
+    w.putArray(meshes.vertices);
+    w.putArray(meshes.indices);
+    return w.finish();
+}
+
+// The tracer indexes the buffers without checks, every range and index has to stay inside them
+static bool validMeshes(MeshBuffers const &meshes)
+{
+    size_t vertexCount = meshes.vertices.size() / vertexWords;
+    uint32_t previousVertex = 0;
+    for (MeshInfo const &mesh : meshes.meshes)
+    {
+        if (mesh.first_vertex < previousVertex || mesh.first_vertex > vertexCount ||
+            size_t(mesh.first_triangle) + mesh.triangle_count > meshes.indices.size() / 3)
+        {
+            return false;
+        }
+        previousVertex = mesh.first_vertex;
+        size_t first = 3 * size_t(mesh.first_triangle);
+        for (size_t i = first; i < first + 3 * size_t(mesh.triangle_count); i++)
+        {
+            if (mesh.first_vertex + size_t(meshes.indices[i]) >= vertexCount)
+            {
+                return false;
+            }
+        }
+    }
+    return meshes.vertices.size() % vertexWords == 0;
+}
+
+static bool parseScene(Reader &r, std::vector<Sphere> &spheres, MeshBuffers &meshes, TraceSettings &settings,
+                       int32_t &width, int32_t &height)
+{
+    width = r.get<int32_t>();
+    height = r.get<int32_t>();
+    settings.viewport_size = r.get<float>();
+    settings.focal_length = r.get<float>();
+    settings.camera_z = r.get<float>();
+    settings.t_min = r.get<float>();
+    settings.t_max = r.get<float>();
+    settings.max_ray_reflections = r.get<int32_t>();
+    settings.samples = r.get<int32_t>();
+    settings.light_sampling = r.get<uint8_t>();
+    uint32_t count = r.get<uint32_t>();
+    spheres.clear();
+    for (uint32_t i = 0; i < count && r.ok(); i++)
+    {
+        glm::vec3 origin = r.getVec3();
+        glm::vec3 color = r.getVec3();
+        float radius = r.get<float>();
+        glm::vec3 emission = r.getVec3();
+        spheres.push_back(Sphere(origin, radius, color, emission));
+    }
+    r.getArray(meshes.meshes);
+    r.getArray(meshes.vertices);
+    r.getArray(meshes.indices);
+    return r.ok() && validMeshes(meshes) && width > 0 && height > 0;
+}
+
+/* Sockets */
+
+struct Address
+{
+    sockaddr_storage storage{};
+    socklen_t length = 0;
+    std::string unixPath;
+};
+
+static bool resolve(std::string const &address, bool listening, Address &out)
+{
+    if (address.starts_with("unix:"))
+    {
+        out.unixPath = address.substr(5);
+        sockaddr_un *un = reinterpret_cast<sockaddr_un *>(&out.storage);
+        if (out.unixPath.empty() || out.unixPath.size() >= sizeof(un->sun_path))
+        {
+            spdlog::error("Invalid unix socket path {}", out.unixPath);
+            return false;
+        }
+        un->sun_family = AF_UNIX;
+        std::strcpy(un->sun_path, out.unixPath.c_str());
+        out.length = sizeof(sockaddr_un);
+        return true;
+    }
+
+    std::string hostPort = address.starts_with("tcp:") ? address.substr(4) : address;
+    size_t colon = hostPort.rfind(':');
+    if (colon == std::string::npos)
+    {
+        spdlog::error("Address {} has no port", address);
+        return false;
+    }
+    std::string host = hostPort.substr(0, colon);
+    std::string port = hostPort.substr(colon + 1);
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = listening ? AI_PASSIVE : 0;
+    addrinfo *result = nullptr;
+    int error = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &result);
+    if (error != 0)
+    {
+        spdlog::error("Could not resolve {}: {}", address, gai_strerror(error));
+        return false;
+    }
+    std::memcpy(&out.storage, result->ai_addr, result->ai_addrlen);
+    out.length = result->ai_addrlen;
+    freeaddrinfo(result);
+    return true;
+}
+
+static int openSocket(Address const &address)
+{
+    int fd = socket(address.storage.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0 && address.storage.ss_family != AF_UNIX)
+    {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    }
+    return fd;
+}
+
+static bool sendAll(int fd, std::vector<uint8_t> const &bytes)
+{
+    size_t sent = 0;
+    while (sent < bytes.size())
+    {
+        ssize_t n = send(fd, bytes.data() + sent, bytes.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return false;
+        }
+        sent += n;
+    }
+    return true;
+}
+
+static bool receiveAll(int fd, uint8_t *data, size_t size)
+{
+    size_t received = 0;
+    while (received < size)
+    {
+        ssize_t n = recv(fd, data + received, size - received, 0);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return false;
+        }
+        received += n;
+    }
+    return true;
+}
+
+// Largest payload a worker accepts for each message type
+static uint32_t maxWorkerPayload(uint32_t type)
+{
+    switch (type)
+    {
+    case SceneMessage:
+        return maxSceneBytes;
+    case TileMessage:
+        return 5 * sizeof(uint32_t);
+    default:
+        return 0;
+    }
+}
+
+// Blocking read of one whole message, used by workers
+static bool receiveMessage(int fd, uint32_t &type, std::vector<uint8_t> &payload)
+{
+    uint32_t header[2];
+    if (!receiveAll(fd, reinterpret_cast<uint8_t *>(header), sizeof(header)))
+    {
+        return false;
+    }
+    type = header[0];
+    if (header[1] > maxWorkerPayload(type))
+    {
+        spdlog::error("Received a message of type {} with {} bytes, more than allowed", type, header[1]);
+        return false;
+    }
+    payload.resize(header[1]);
+    return receiveAll(fd, payload.data(), payload.size());
+}
+
+/* Coordinator */
+
+namespace
+{
+struct WorkerConnection
+{
+    int fd;
+    uint32_t index;
+    std::vector<uint8_t> buffer;
+    std::vector<uint32_t> assigned;
+    Clock::time_point lastMessage;
+};
+
+struct TileState
+{
+    Tile tile;
+    bool done = false;
+    // Workers currently holding this tile
+    uint32_t owners = 0;
+    // When the first of them got it, duplicates don't reset the age
+    Clock::time_point assignedAt;
+};
+} // namespace
+
+static std::vector<pid_t> spawnWorkers(std::string const &address, uint32_t count, uint32_t threads)
+{
+    std::vector<pid_t> children;
+    std::string threadArg = std::to_string(threads);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            execl("/proc/self/exe", "ray", "--worker", address.c_str(), "--threads", threadArg.c_str(), nullptr);
+            _exit(127);
+        }
+        if (pid < 0)
+        {
+            spdlog::error("Could not start a local worker: {}", std::strerror(errno));
+            break;
+        }
+        children.push_back(pid);
+    }
+    return children;
+}
+
+bool renderDistributed(std::vector<Sphere> const &spheres, MeshBuffers const &meshes, TraceSettings const &settings,
+                       Image &image, DistributedOptions const &options, DistributedStats &stats)
+{
+    std::vector<uint8_t> scene = sceneMessage(spheres, meshes, settings, image.width, image.height);
+    if (scene.size() - 8 > maxSceneBytes)
+    {
+        spdlog::error("Scene takes {} MB, workers accept at most {} MB", scene.size() >> 20, maxSceneBytes >> 20);
+        return false;
+    }
+
+    Address address;
+    if (!resolve(options.address, true, address))
+    {
+        return false;
+    }
+    if (!address.unixPath.empty())
+    {
+        unlink(address.unixPath.c_str());
+    }
+    int listenFd = openSocket(address);
+    if (listenFd < 0 || bind(listenFd, reinterpret_cast<sockaddr *>(&address.storage), address.length) != 0 ||
+        listen(listenFd, 64) != 0)
+    {
+        spdlog::error("Could not listen on {}: {}", options.address, std::strerror(errno));
+        if (listenFd >= 0)
+        {
+            close(listenFd);
+        }
+        return false;
+    }
+
+    std::vector<TileState> tiles;
+    std::deque<uint32_t> pending;
+    for (int32_t y = 0; y < image.height; y += options.tileSize)
+    {
+        for (int32_t x = 0; x < image.width; x += options.tileSize)
+        {
+            pending.push_back(tiles.size());
+            TileState state;
+            state.tile = Tile{x, y, std::min(options.tileSize, image.width - x),
+                              std::min(options.tileSize, image.height - y)};
+            tiles.push_back(state);
+        }
+    }
+    size_t tilesDone = 0;
+    // Tile id and the pixels of a full tile
+    size_t maxResultBytes = sizeof(uint32_t) + size_t(options.tileSize) * options.tileSize * sizeof(glm::vec3);
+
+    std::vector<std::unique_ptr<WorkerConnection>> workers;
+    stats = DistributedStats();
+    auto start = Clock::now();
+    auto lastActivity = start;
+    // Time from handing out a tile to its result, queueing on the worker included
+    double tileSeconds = 0;
+    auto averageTileSeconds = [&]() { return tilesDone ? tileSeconds / tilesDone : 0.0; };
+    std::vector<pid_t> children = spawnWorkers(options.address, options.localWorkers, options.workerThreads);
+
+    auto fail = [&](WorkerConnection &worker) {
+        spdlog::warn("Worker {} disconnected with {} tiles, reassigning", worker.index, worker.assigned.size());
+        for (uint32_t id : worker.assigned)
+        {
+            TileState &t = tiles[id];
+            t.owners--;
+            if (!t.done && t.owners == 0)
+            {
+                pending.push_front(id);
+            }
+        }
+        worker.assigned.clear();
+        close(worker.fd);
+        worker.fd = -1;
+        stats.failures++;
+    };
+
+    auto fill = [&](WorkerConnection &worker) {
+        while (worker.fd >= 0 && worker.assigned.size() < options.queueDepth)
+        {
+            int64_t id = -1;
+            while (!pending.empty() && id < 0)
+            {
+                id = pending.front();
+                pending.pop_front();
+                if (tiles[id].done)
+                {
+                    id = -1;
+                }
+            }
+            if (id < 0)
+            {
+                // Nothing left to hand out, duplicate the tile that has been waiting on another worker longest,
+                // but only once it takes well over the average so a normal last round isn't done twice
+                auto stealAfter = std::chrono::duration<double>(options.stealFactor * averageTileSeconds());
+                for (uint32_t i = 0; i < tiles.size() && tilesDone > 0; i++)
+                {
+                    TileState const &t = tiles[i];
+                    if (t.done || t.owners != 1 || Clock::now() - t.assignedAt < stealAfter ||
+                        std::find(worker.assigned.begin(), worker.assigned.end(), i) != worker.assigned.end())
+                    {
+                        continue;
+                    }
+                    if (id < 0 || t.assignedAt < tiles[id].assignedAt)
+                    {
+                        id = i;
+                    }
+                }
+                if (id < 0)
+                {
+                    return;
+                }
+                stats.stolen++;
+            }
+
+            Tile const &tile = tiles[id].tile;
+            Writer w(TileMessage);
+            w.put<uint32_t>(id);
+            w.put(tile.x);
+            w.put(tile.y);
+            w.put(tile.width);
+            w.put(tile.height);
+            worker.assigned.push_back(id);
+            if (tiles[id].owners++ == 0)
+            {
+                tiles[id].assignedAt = Clock::now();
+            }
+            if (!sendAll(worker.fd, w.finish()))
+            {
+                fail(worker);
+            }
+        }
+    };
+
+    auto handleResult = [&](WorkerConnection &worker, std::vector<uint8_t> const &payload) {
+        Reader r(payload);
+        uint32_t id = r.get<uint32_t>();
+        if (id >= tiles.size())
+        {
+            return false;
+        }
+        TileState &t = tiles[id];
+        if (payload.size() != sizeof(uint32_t) + size_t(t.tile.width) * t.tile.height * sizeof(glm::vec3))
+        {
+            return false;
+        }
+        auto it = std::find(worker.assigned.begin(), worker.assigned.end(), id);
+        if (it != worker.assigned.end())
+        {
+            worker.assigned.erase(it);
+            t.owners--;
+        }
+        if (t.done)
+        {
+            return true;
+        }
+        for (int32_t y = t.tile.y; y < t.tile.y + t.tile.height; y++)
+        {
+            for (int32_t x = t.tile.x; x < t.tile.x + t.tile.width; x++)
+            {
+                image.at(x, y) = r.getVec3();
+            }
+        }
+        t.done = true;
+        tilesDone++;
+        tileSeconds += std::chrono::duration<double>(Clock::now() - t.assignedAt).count();
+        stats.tilesPerWorker[worker.index]++;
+        return true;
+    };
+
+    while (tilesDone < tiles.size())
+    {
+        std::vector<pollfd> fds = {{listenFd, POLLIN, 0}};
+        for (auto &worker : workers)
+        {
+            fds.push_back({worker->fd, POLLIN, 0});
+        }
+        if (poll(fds.data(), fds.size(), 100) < 0 && errno != EINTR)
+        {
+            spdlog::error("poll failed: {}", std::strerror(errno));
+            break;
+        }
+
+        if (fds[0].revents & POLLIN)
+        {
+            int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd >= 0)
+            {
+                auto worker = std::make_unique<WorkerConnection>();
+                worker->fd = fd;
+                worker->index = stats.workers++;
+                worker->lastMessage = Clock::now();
+                stats.tilesPerWorker.push_back(0);
+                spdlog::info("Worker {} connected", worker->index);
+                if (sendAll(fd, scene))
+                {
+                    fill(*worker);
+                }
+                else
+                {
+                    fail(*worker);
+                }
+                workers.push_back(std::move(worker));
+            }
+        }
+
+        // Workers accepted above are not in fds yet, they are polled from the next iteration on
+        for (size_t i = 0; i + 1 < fds.size(); i++)
+        {
+            WorkerConnection &worker = *workers[i];
+            if (worker.fd < 0 || !(fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR)))
+            {
+                continue;
+            }
+            uint8_t chunk[65536];
+            ssize_t n = recv(worker.fd, chunk, sizeof(chunk), 0);
+            if (n <= 0)
+            {
+                fail(worker);
+                continue;
+            }
+            lastActivity = Clock::now();
+            worker.lastMessage = lastActivity;
+            worker.buffer.insert(worker.buffer.end(), chunk, chunk + n);
+
+            // Handle every complete message in the buffer
+            size_t offset = 0;
+            while (worker.buffer.size() - offset >= 8)
+            {
+                uint32_t header[2];
+                std::memcpy(header, worker.buffer.data() + offset, sizeof(header));
+                if (header[1] > maxResultBytes)
+                {
+                    spdlog::error("Worker {} announced a message of {} bytes", worker.index, header[1]);
+                    fail(worker);
+                    break;
+                }
+                if (worker.buffer.size() - offset - 8 < header[1])
+                {
+                    break;
+                }
+                std::vector<uint8_t> payload(worker.buffer.begin() + offset + 8,
+                                             worker.buffer.begin() + offset + 8 + header[1]);
+                offset += 8 + header[1];
+                if (header[0] != ResultMessage || !handleResult(worker, payload))
+                {
+                    spdlog::error("Worker {} sent a malformed message", worker.index);
+                    fail(worker);
+                    break;
+                }
+            }
+            if (worker.fd >= 0)
+            {
+                worker.buffer.erase(worker.buffer.begin(), worker.buffer.begin() + offset);
+            }
+        }
+
+        // A connected worker that stopped answering would otherwise hold its tiles forever
+        auto timeout = std::chrono::duration<double>(std::max(options.workerTimeoutSeconds, 10 * averageTileSeconds()));
+        for (auto &worker : workers)
+        {
+            if (worker->fd >= 0 && !worker->assigned.empty() && Clock::now() - worker->lastMessage > timeout)
+            {
+                spdlog::error("Worker {} sent nothing for {:.0f} s", worker->index, timeout.count());
+                fail(*worker);
+            }
+        }
+        std::erase_if(workers, [](auto const &worker) { return worker->fd < 0; });
+        for (auto &worker : workers)
+        {
+            fill(*worker);
+        }
+        std::erase_if(workers, [](auto const &worker) { return worker->fd < 0; });
+
+        if (workers.empty() && Clock::now() - lastActivity > std::chrono::seconds(30))
+        {
+            spdlog::error("No worker connected for 30 seconds, giving up with {}/{} tiles", tilesDone, tiles.size());
+            break;
+        }
+    }
+    stats.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    Writer shutdown(ShutdownMessage);
+    for (auto &worker : workers)
+    {
+        sendAll(worker->fd, shutdown.finish());
+        close(worker->fd);
+    }
+    close(listenFd);
+    if (!address.unixPath.empty())
+    {
+        unlink(address.unixPath.c_str());
+    }
+    // A hung local worker never reads the shutdown, give them a moment and kill what is left
+    auto deadline = Clock::now() + std::chrono::seconds(5);
+    for (pid_t pid : children)
+    {
+        while (waitpid(pid, nullptr, WNOHANG) == 0)
+        {
+            if (Clock::now() > deadline)
+            {
+                kill(pid, SIGKILL);
+                waitpid(pid, nullptr, 0);
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+    return tilesDone == tiles.size();
+}
+
+/* Worker */
+
+int runWorker(std::string const &address, uint32_t threads)
+{
+    Address target;
+    if (!resolve(address, false, target))
+    {
+        return EXIT_FAILURE;
+    }
+
+    // The coordinator may still be starting up
+    int fd = -1;
+    for (int attempt = 0; attempt < 50 && fd < 0; attempt++)
+    {
+        fd = openSocket(target);
+        if (fd >= 0 && connect(fd, reinterpret_cast<sockaddr *>(&target.storage), target.length) != 0)
+        {
+            close(fd);
+            fd = -1;
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+    }
+    if (fd < 0)
+    {
+        spdlog::error("Could not connect to {}", address);
+        return EXIT_FAILURE;
+    }
+
+    std::unique_ptr<CpuTracer> tracer;
+    Image image;
+    uint32_t type;
+    std::vector<uint8_t> payload;
+    while (receiveMessage(fd, type, payload))
+    {
+        Reader r(payload);
+        if (type == SceneMessage)
+        {
+            std::vector<Sphere> spheres;
+            MeshBuffers meshes;
+            TraceSettings settings;
+            int32_t width, height;
+            if (!parseScene(r, spheres, meshes, settings, width, height))
+            {
+                spdlog::error("Received a malformed scene");
+                break;
+            }
+            tracer = std::make_unique<CpuTracer>(spheres, meshes, settings);
+            tracer->setThreads(threads);
+            image = Image(width, height);
+        }
+        else if (type == TileMessage && tracer)
+        {
+            uint32_t id = r.get<uint32_t>();
+            Tile tile;
+            tile.x = r.get<int32_t>();
+            tile.y = r.get<int32_t>();
+            tile.width = r.get<int32_t>();
+            tile.height = r.get<int32_t>();
+            if (!r.ok() || tile.x < 0 || tile.y < 0 || tile.x + tile.width > image.width ||
+                tile.y + tile.height > image.height)
+            {
+                spdlog::error("Received a malformed tile");
+                break;
+            }
+            tracer->render(image, tile);
+
+            Writer w(ResultMessage);
+            w.put(id);
+            for (int32_t y = tile.y; y < tile.y + tile.height; y++)
+            {
+                for (int32_t x = tile.x; x < tile.x + tile.width; x++)
+                {
+                    w.putVec3(image.at(x, y));
+                }
+            }
+            if (!sendAll(fd, w.finish()))
+            {
+                break;
+            }
+        }
+        else if (type == ShutdownMessage)
+        {
+            close(fd);
+            return EXIT_SUCCESS;
+        }
+    }
+    close(fd);
+    return EXIT_FAILURE;
+}
@@ -1,5 +1,6 @@
 #include "ezgl.hpp"
 #include <GL/gl.h>
+#include <algorithm>
 #include <cstdlib>
 #include <filesystem>
 #include <fstream>
@@ -64,41 +65,503 @@ void checkError()
     }
 }
 
+/* State */
+
+// GL 4.5 entry points, the bundled loader only goes up to 4.3
+typedef void(APIENTRYP PFNCREATEBUFFERS)(GLsizei n, GLuint *buffers);
+typedef void(APIENTRYP PFNNAMEDBUFFERDATA)(GLuint buffer, GLsizeiptr size, void const *data, GLenum usage);
+typedef void(APIENTRYP PFNNAMEDBUFFERSUBDATA)(GLuint buffer, GLintptr offset, GLsizeiptr size, void const *data);
+typedef void *(APIENTRYP PFNMAPNAMEDBUFFERRANGE)(GLuint buffer, GLintptr offset, GLsizeiptr length,
+                                                 GLbitfield access);
+typedef GLboolean(APIENTRYP PFNUNMAPNAMEDBUFFER)(GLuint buffer);
+typedef void(APIENTRYP PFNCREATEVERTEXARRAYS)(GLsizei n, GLuint *arrays);
+typedef void(APIENTRYP PFNVERTEXARRAYVERTEXBUFFER)(GLuint vaobj, GLuint bindingindex, GLuint buffer, GLintptr offset,
+                                                  GLsizei stride);
+typedef void(APIENTRYP PFNVERTEXARRAYATTRIBFORMAT)(GLuint vaobj, GLuint attribindex, GLint size, GLenum type,
+                                                  GLboolean normalized, GLuint relativeoffset);
+typedef void(APIENTRYP PFNVERTEXARRAYATTRIBBINDING)(GLuint vaobj, GLuint attribindex, GLuint bindingindex);
+typedef void(APIENTRYP PFNENABLEVERTEXARRAYATTRIB)(GLuint vaobj, GLuint index);
+
+static struct
+{
+    PFNCREATEBUFFERS createBuffers;
+    PFNNAMEDBUFFERDATA namedBufferData;
+    PFNNAMEDBUFFERSUBDATA namedBufferSubData;
+    PFNMAPNAMEDBUFFERRANGE mapNamedBufferRange;
+    PFNUNMAPNAMEDBUFFER unmapNamedBuffer;
+    PFNCREATEVERTEXARRAYS createVertexArrays;
+    PFNVERTEXARRAYVERTEXBUFFER vertexArrayVertexBuffer;
+    PFNVERTEXARRAYATTRIBFORMAT vertexArrayAttribFormat;
+    PFNVERTEXARRAYATTRIBBINDING vertexArrayAttribBinding;
+    PFNENABLEVERTEXARRAYATTRIB enableVertexArrayAttrib;
+} dsa;
+
+ContextState &state()
+{
+    thread_local ContextState s;
+    return s;
+}
+
+static void count(uint32_t calls = 1)
+{
+    state().frame.calls += calls;
+}
+
+static void skip()
+{
+    state().frame.skipped++;
+}
+
+void loadExtensions(GLADloadproc load)
+{
+    bool available = GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 5);
+    GLint extensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &extensions);
+    for (GLint i = 0; i < extensions && !available; i++)
+    {
+        available = std::string_view((char const *)glGetStringi(GL_EXTENSIONS, i)) == "GL_ARB_direct_state_access";
+    }
+
+    if (available)
+    {
+        dsa.createBuffers = (PFNCREATEBUFFERS)load("glCreateBuffers");
+        dsa.namedBufferData = (PFNNAMEDBUFFERDATA)load("glNamedBufferData");
+        dsa.namedBufferSubData = (PFNNAMEDBUFFERSUBDATA)load("glNamedBufferSubData");
+        dsa.mapNamedBufferRange = (PFNMAPNAMEDBUFFERRANGE)load("glMapNamedBufferRange");
+        dsa.unmapNamedBuffer = (PFNUNMAPNAMEDBUFFER)load("glUnmapNamedBuffer");
+        dsa.createVertexArrays = (PFNCREATEVERTEXARRAYS)load("glCreateVertexArrays");
+        dsa.vertexArrayVertexBuffer = (PFNVERTEXARRAYVERTEXBUFFER)load("glVertexArrayVertexBuffer");
+        dsa.vertexArrayAttribFormat = (PFNVERTEXARRAYATTRIBFORMAT)load("glVertexArrayAttribFormat");
+        dsa.vertexArrayAttribBinding = (PFNVERTEXARRAYATTRIBBINDING)load("glVertexArrayAttribBinding");
+        dsa.enableVertexArrayAttrib = (PFNENABLEVERTEXARRAYATTRIB)load("glEnableVertexArrayAttrib");
+        available = dsa.createBuffers && dsa.namedBufferData && dsa.namedBufferSubData && dsa.mapNamedBufferRange &&
+                    dsa.unmapNamedBuffer && dsa.createVertexArrays && dsa.vertexArrayVertexBuffer &&
+                    dsa.vertexArrayAttribFormat && dsa.vertexArrayAttribBinding && dsa.enableVertexArrayAttrib;
+    }
+    state().directStateAccess = available;
+    spdlog::info("Direct state access {}", available ? "enabled" : "not available");
+}
+
+bool hasDirectStateAccess()
+{
+    return state().directStateAccess;
+}
+
+void invalidateState()
+{
+    // No GL object has this name, so the next bind always goes through
+    ContextState &s = state();
+    s.program = ~0u;
+    s.vertexArray = ~0u;
+    s.activeTexture = ~0u;
+    s.buffers.clear();
+    s.bufferBases.clear();
+    s.textures.clear();
+}
+
+CallStats endFrame()
+{
+    CallStats finished = state().frame;
+    state().frame = CallStats();
+    return finished;
+}
+
+/* Memory */
+
+char const *resourceTypeName(ResourceType type)
+{
+    switch (type)
+    {
+    case ResourceType::Buffer:
+        return "Buffer";
+    case ResourceType::Texture:
+        return "Texture";
+    case ResourceType::Program:
+        return "Program";
+    }
+    return "Resource";
+}
+
+std::string usageName(GLenum usage)
+{
+    switch (usage)
+    {
+    case 0:
+        return "";
+    case GL_STREAM_DRAW:
+        return "stream draw";
+    case GL_STREAM_READ:
+        return "stream read";
+    case GL_STREAM_COPY:
+        return "stream copy";
+    case GL_STATIC_DRAW:
+        return "static draw";
+    case GL_STATIC_READ:
+        return "static read";
+    case GL_STATIC_COPY:
+        return "static copy";
+    case GL_DYNAMIC_DRAW:
+        return "dynamic draw";
+    case GL_DYNAMIC_READ:
+        return "dynamic read";
+    case GL_DYNAMIC_COPY:
+        return "dynamic copy";
+    case GL_RGBA32F:
+        return "rgba32f";
+    }
+    return fmt::format("0x{:04x}", usage);
+}
+
+static GLenum objectIdentifier(ResourceType type)
+{
+    switch (type)
+    {
+    case ResourceType::Buffer:
+        return GL_BUFFER;
+    case ResourceType::Texture:
+        return GL_TEXTURE;
+    case ResourceType::Program:
+        return GL_PROGRAM;
+    }
+    return GL_BUFFER;
+}
+
+void trackResource(ResourceType type, GLuint id, std::string const &label)
+{
+    auto [it, added] = state().resources.try_emplace({type, id});
+    it->second.type = type;
+    it->second.label = label.empty() ? fmt::format("{} {}", resourceTypeName(type), id) : label;
+    state().memory.typeCount[size_t(type)] += added;
+}
+
+void setResourceSize(ResourceType type, GLuint id, size_t bytes, GLenum usage)
+{
+    auto it = state().resources.find({type, id});
+    if (it == state().resources.end())
+    {
+        return;
+    }
+    Resource &resource = it->second;
+    if (resource.allocations == 0)
+    {
+        glObjectLabel(objectIdentifier(type), id, resource.label.size(), resource.label.c_str());
+        count();
+    }
+
+    MemoryStats &memory = state().memory;
+    size_t t = size_t(type);
+    memory.bytes = memory.bytes - resource.bytes + bytes;
+    memory.typeBytes[t] = memory.typeBytes[t] - resource.bytes + bytes;
+    memory.peakBytes = std::max(memory.peakBytes, memory.bytes);
+    memory.typePeakBytes[t] = std::max(memory.typePeakBytes[t], memory.typeBytes[t]);
+    resource.bytes = bytes;
+    resource.usage = usage;
+    resource.allocations++;
+}
+
+void untrackResource(ResourceType type, GLuint id)
+{
+    auto it = state().resources.find({type, id});
+    if (it == state().resources.end())
+    {
+        return;
+    }
+    MemoryStats &memory = state().memory;
+    size_t t = size_t(type);
+    memory.bytes -= it->second.bytes;
+    memory.typeBytes[t] -= it->second.bytes;
+    memory.typeCount[t]--;
+    state().resources.erase(it);
+}
+
+std::map<std::pair<ResourceType, GLuint>, Resource> const &resources()
+{
+    return state().resources;
+}
+
+MemoryStats const &memoryStats()
+{
+    return state().memory;
+}
+
+void logMemoryUsage()
+{
+    MemoryStats const &memory = memoryStats();
+    auto mb = [](size_t bytes) { return bytes / double(1 << 20); };
+    spdlog::info("GPU memory peak {:.2f} MB", mb(memory.peakBytes));
+    spdlog::info("GPU memory maximum per type: buffers {:.2f} MB, textures {:.2f} MB, programs {:.2f} MB",
+                 mb(memory.typePeakBytes[0]), mb(memory.typePeakBytes[1]), mb(memory.typePeakBytes[2]));
+    spdlog::info("GPU memory live {:.2f} MB in {} objects", mb(memory.bytes), resources().size());
+}
+
+void bindBuffer(GLenum target, GLuint id)
+{
+    auto &bound = state().buffers;
+    auto it = bound.find(target);
+    if (it != bound.end() && it->second == id)
+    {
+        skip();
+        return;
+    }
+    glBindBuffer(target, id);
+    bound[target] = id;
+    count();
+}
+
+void bindBufferBase(GLenum target, GLuint index, GLuint id)
+{
+    auto &bases = state().bufferBases;
+    auto it = bases.find({target, index});
+    if (it != bases.end() && it->second == id)
+    {
+        skip();
+        return;
+    }
+    glBindBufferBase(target, index, id);
+    bases[{target, index}] = id;
+    // Also binds the generic binding point
+    state().buffers[target] = id;
+    count();
+}
+
+void useProgram(GLuint id)
+{
+    if (state().program == id)
+    {
+        skip();
+        return;
+    }
+    glUseProgram(id);
+    state().program = id;
+    count();
+}
+
+void bindVertexArray(GLuint id)
+{
+    if (state().vertexArray == id)
+    {
+        skip();
+        return;
+    }
+    glBindVertexArray(id);
+    state().vertexArray = id;
+    count();
+}
+
+void activeTexture(GLuint unit)
+{
+    if (state().activeTexture == unit)
+    {
+        skip();
+        return;
+    }
+    glActiveTexture(GL_TEXTURE0 + unit);
+    state().activeTexture = unit;
+    count();
+}
+
+void bindTexture(GLenum target, GLuint id)
+{
+    if (state().activeTexture == ~0u)
+    {
+        activeTexture(0);
+    }
+    auto &bound = state().textures;
+    auto key = std::make_pair(state().activeTexture, target);
+    auto it = bound.find(key);
+    if (it != bound.end() && it->second == id)
+    {
+        skip();
+        return;
+    }
+    glBindTexture(target, id);
+    bound[key] = id;
+    count();
+}
+
+void deleteTexture(GLuint id)
+{
+    glDeleteTextures(1, &id);
+    count();
+    untrackResource(ResourceType::Texture, id);
+    // Deleting a bound texture resets its bindings to zero
+    for (auto &[binding, bound] : state().textures)
+    {
+        if (bound == id)
+        {
+            bound = 0;
+        }
+    }
+}
+
+GLuint createBuffer(std::string const &label)
+{
+    GLuint id;
+    if (hasDirectStateAccess())
+    {
+        dsa.createBuffers(1, &id);
+    }
+    else
+    {
+        glGenBuffers(1, &id);
+    }
+    count();
+    trackResource(ResourceType::Buffer, id, label);
+    return id;
+}
+
+void deleteBuffer(GLuint id)
+{
+    glDeleteBuffers(1, &id);
+    count();
+    untrackResource(ResourceType::Buffer, id);
+    // Deleting a bound buffer resets its bindings to zero
+    for (auto &[target, bound] : state().buffers)
+    {
+        if (bound == id)
+        {
+            bound = 0;
+        }
+    }
+    for (auto &[binding, bound] : state().bufferBases)
+    {
+        if (bound == id)
+        {
+            bound = 0;
+        }
+    }
+}
+
+void bufferData(GLuint id, GLenum target, GLsizeiptr size, void const *data, GLenum usage)
+{
+    if (hasDirectStateAccess())
+    {
+        dsa.namedBufferData(id, size, data, usage);
+    }
+    else
+    {
+        bindBuffer(target, id);
+        glBufferData(target, size, data, usage);
+    }
+    count();
+    setResourceSize(ResourceType::Buffer, id, size, usage);
+}
+
+void bufferSubData(GLuint id, GLenum target, GLintptr offset, GLsizeiptr size, void const *data)
+{
+    if (hasDirectStateAccess())
+    {
+        dsa.namedBufferSubData(id, offset, size, data);
+    }
+    else
+    {
+        bindBuffer(target, id);
+        glBufferSubData(target, offset, size, data);
+    }
+    count();
+}
+
+void viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    glViewport(x, y, width, height);
+    count();
+}
+
+void clear(GLbitfield mask)
+{
+    glClear(mask);
+    count();
+}
+
+void memoryBarrier(GLbitfield barriers)
+{
+    glMemoryBarrier(barriers);
+    count();
+}
+
+void readPixels(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, void *pixels)
+{
+    glReadPixels(x, y, width, height, format, type, pixels);
+    count();
+}
+
+GLsync fenceSync()
+{
+    count();
+    return glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+GLenum clientWaitSync(GLsync sync, GLbitfield flags, GLuint64 timeout)
+{
+    count();
+    return glClientWaitSync(sync, flags, timeout);
+}
+
+void deleteSync(GLsync sync)
+{
+    glDeleteSync(sync);
+    count();
+}
+
 /* VertexBuffer */
 
-VertexBuffer::VertexBuffer(bool dynamic)
+VertexBuffer::VertexBuffer(bool dynamic, std::string const &label) : dynamic(dynamic)
 {
-    glGenBuffers(1, &this->id);
+    this->id = createBuffer(label);
 }
 
 VertexBuffer::~VertexBuffer()
 {
-    glDeleteBuffers(1, &this->id);
+    deleteBuffer(this->id);
+}
+
+GLuint VertexBuffer::getId()
+{
+    return this->id;
 }
 
 void VertexBuffer::bind()
 {
-    glBindBuffer(GL_ARRAY_BUFFER, this->id);
+    bindBuffer(GL_ARRAY_BUFFER, this->id);
 }
 
 /* VertexArray */
 VertexArray::VertexArray()
 {
-    glGenVertexArrays(1, &this->id);
-    this->bind();
+    if (hasDirectStateAccess())
+    {
+        dsa.createVertexArrays(1, &this->id);
+    }
+    else
+    {
+        glGenVertexArrays(1, &this->id);
+    }
+    count();
 }
 
 VertexArray::~VertexArray()
 {
+    if (state().vertexArray == this->id)
+    {
+        state().vertexArray = 0;
+    }
     glDeleteVertexArrays(1, &this->id);
+    count();
 }
 
 void VertexArray::bind()
 {
-    glBindVertexArray(this->id);
+    bindVertexArray(this->id);
+}
+
+void VertexArray::draw(GLenum mode, GLint first, GLsizei count)
+{
+    this->bind();
+    glDrawArrays(mode, first, count);
+    ez::count();
 }
 
-void VertexArray::attributes(std::initializer_list<std::pair<GLenum, GLint>> elements)
+void VertexArray::attributes(VertexBuffer &buffer, std::initializer_list<std::pair<GLenum, GLint>> elements)
 {
     spdlog::debug("Setting attributes for {}", this->id);
     GLint stride = 0;
@@ -107,13 +570,35 @@ void VertexArray::attributes(std::initializer_list<std::pair<GLenum, GLint>> ele
         stride += getGLTypeSize(p.first) * p.second;
     }
 
+    bool direct = hasDirectStateAccess();
+    if (direct)
+    {
+        dsa.vertexArrayVertexBuffer(this->id, 0, buffer.getId(), 0, stride);
+    }
+    else
+    {
+        this->bind();
+        buffer.bind();
+    }
+
     size_t offset = 0;
     GLint counter = 0;
     for (auto const &p : elements)
     {
         GLint size = getGLTypeSize(p.first) * p.second;
-        glVertexAttribPointer(counter, p.second, p.first, GL_FALSE, stride, (GLvoid *)offset);
-        glEnableVertexAttribArray(counter);
+        if (direct)
+        {
+            dsa.vertexArrayAttribFormat(this->id, counter, p.second, p.first, GL_FALSE, offset);
+            dsa.vertexArrayAttribBinding(this->id, counter, 0);
+            dsa.enableVertexArrayAttrib(this->id, counter);
+            count(3);
+        }
+        else
+        {
+            glVertexAttribPointer(counter, p.second, p.first, GL_FALSE, stride, (GLvoid *)offset);
+            glEnableVertexAttribArray(counter);
+            count(2);
+        }
 
         spdlog::debug("VAO {}: Attr: {} size: {} type: {} stride: {} offset: {}", this->id, counter, p.second, p.first,
                       stride, offset);
@@ -174,8 +659,15 @@ std::string readFile(std::string_view path, std::vector<std::string> &includes)
     return content;
 }
 
-Program::Program(std::string const &vertexPath, std::string const &fragmentPath, bool autoreload)
-    : autoreload(autoreload), vertexPath(vertexPath), fragmentPath(fragmentPath)
+Program::Program(std::string const &vertexPath, std::string const &fragmentPath, bool autoreload,
+                 FileChangedHandler onFileChanged)
+    : Program({{GL_VERTEX_SHADER, vertexPath}, {GL_FRAGMENT_SHADER, fragmentPath}}, autoreload, onFileChanged)
+{
+}
+
+Program::Program(std::initializer_list<std::pair<GLenum, std::string>> stages, bool autoreload,
+                 FileChangedHandler onFileChanged)
+    : autoreload(autoreload), stages(stages), onFileChanged(onFileChanged)
 {
     this->compile();
     if (autoreload)
@@ -187,7 +679,29 @@ Program::Program(std::string const &vertexPath, std::string const &fragmentPath,
 
 Program::~Program()
 {
+    if (state().program == GLuint(this->id))
+    {
+        useProgram(0);
+    }
     glDeleteProgram(this->id);
+    count();
+    untrackResource(ResourceType::Program, this->id);
+}
+
+static char const *stageName(GLenum stage)
+{
+    switch (stage)
+    {
+    case GL_VERTEX_SHADER:
+        return "VertexShader";
+    case GL_FRAGMENT_SHADER:
+        return "FragmentShader";
+    case GL_GEOMETRY_SHADER:
+        return "GeometryShader";
+    case GL_COMPUTE_SHADER:
+        return "ComputeShader";
+    }
+    return "Shader";
 }
 
 void Program::compile()
@@ -195,51 +709,49 @@ void Program::compile()
     needsRecompile = false;
     includedFiles.clear();
 
-    std::string vertexSource = readFile(this->vertexPath, this->includedFiles);
-    std::string fragmentSource = readFile(this->fragmentPath, this->includedFiles);
-    /* spdlog::info("{}", vertexSource); */
-    /* spdlog::info("{}", fragmentSource); */
-    for (auto const &e : this->includedFiles)
-    {
-        spdlog::debug("Includes {}", e);
-    }
-    GLint vertShader, fragShader;
-    vertShader = glCreateShader(GL_VERTEX_SHADER);
-    fragShader = glCreateShader(GL_FRAGMENT_SHADER);
-
     int success;
     char infoLog[512];
-
-    const char *tmp = vertexSource.c_str();
-    glShaderSource(vertShader, 1, &tmp, NULL);
-    glCompileShader(vertShader);
-    glGetShaderiv(vertShader, GL_COMPILE_STATUS, &success);
-
-    if (!success)
+    std::vector<GLuint> shaders;
+    for (auto const &[stage, path] : this->stages)
     {
-        glGetShaderInfoLog(vertShader, 512, NULL, infoLog);
-        spdlog::error("VertexShader compilation failed \n{}", infoLog);
-        return;
-    }
+        std::string source = readFile(path, this->includedFiles);
+        /* spdlog::info("{}", source); */
+        GLuint shader = glCreateShader(stage);
+        shaders.push_back(shader);
 
-    tmp = fragmentSource.c_str();
-    glShaderSource(fragShader, 1, &tmp, NULL);
-    glCompileShader(fragShader);
-    glGetShaderiv(fragShader, GL_COMPILE_STATUS, &success);
+        const char *tmp = source.c_str();
+        glShaderSource(shader, 1, &tmp, NULL);
+        glCompileShader(shader);
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+        count(4);
 
-    if (!success)
+        if (!success)
+        {
+            glGetShaderInfoLog(shader, 512, NULL, infoLog);
+            spdlog::error("{} compilation failed \n{}", stageName(stage), infoLog);
+            for (GLuint s : shaders)
+            {
+                glDeleteShader(s);
+            }
+            count(1 + shaders.size());
+            return;
+        }
+    }
+    for (auto const &e : this->includedFiles)
     {
-        glGetShaderInfoLog(fragShader, 512, NULL, infoLog);
-        spdlog::error("FragmentShader compilation failed \n{}", infoLog);
-        return;
+        spdlog::debug("Includes {}", e);
     }
 
     if (this->id)
     {
-        glUseProgram(0);
+        useProgram(0);
         glDeleteProgram(this->id);
+        count();
+        untrackResource(ResourceType::Program, this->id);
     }
+    uniformLocations.clear();
     this->id = glCreateProgram();
+    count();
     if (this->id == 0)
     {
         auto e = glGetError();
@@ -247,18 +759,35 @@ void Program::compile()
         exit(EXIT_FAILURE);
     }
 
-    glAttachShader(this->id, vertShader);
-    glAttachShader(this->id, fragShader);
+    for (GLuint shader : shaders)
+    {
+        glAttachShader(this->id, shader);
+    }
+    // Without the hint many drivers report a binary length of zero
+    glProgramParameteri(this->id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glLinkProgram(this->id);
 
+    for (GLuint shader : shaders)
+    {
+        glDeleteShader(shader);
+    }
     glGetProgramiv(this->id, GL_LINK_STATUS, &success);
+    // Attach and delete for every shader, the hint, link and status query
+    count(2 * shaders.size() + 3);
     if (!success)
     {
         glGetProgramInfoLog(this->id, 512, NULL, infoLog);
+        count();
         spdlog::error("Linking Program failed \n{}", infoLog);
+        return;
     }
-    glDeleteShader(vertShader);
-    glDeleteShader(fragShader);
+    // The driver doesn't report program memory, the binary is the closest estimate
+    GLint binaryLength = 0;
+    glGetProgramiv(this->id, GL_PROGRAM_BINARY_LENGTH, &binaryLength);
+    count();
+    trackResource(ResourceType::Program, this->id, label());
+    setResourceSize(ResourceType::Program, this->id, binaryLength, 0);
+    generation++;
     spdlog::info("Recompiled shaders");
 }
 
@@ -273,48 +802,95 @@ void Program::use()
     {
         this->compile();
     }
-    glUseProgram(this->id);
+    useProgram(this->id);
+}
+
+void Program::dispatch(GLuint x, GLuint y, GLuint z)
+{
+    this->use();
+    glDispatchCompute(x, y, z);
+    count();
+}
+
+std::string Program::label()
+{
+    std::string label;
+    for (auto const &[stage, path] : this->stages)
+    {
+        label += (label.empty() ? "" : " + ") + fs::path(path).filename().string();
+    }
+    return label;
+}
+
+uint32_t Program::getGeneration()
+{
+    return this->generation;
+}
+
+GLint Program::location(std::string const &name)
+{
+    auto it = uniformLocations.find(name);
+    if (it != uniformLocations.end())
+    {
+        return it->second;
+    }
+    GLint location = glGetUniformLocation(this->id, name.c_str());
+    count();
+    uniformLocations[name] = location;
+    return location;
 }
 
 void Program::setInt(std::string const &name, uint32_t value)
 {
-    glUniform1i(glGetUniformLocation(this->id, name.c_str()), value);
+    glProgramUniform1i(this->id, location(name), value);
+    count();
 }
 void Program::setFloat(std::string const &name, float value)
 {
-    glUniform1f(glGetUniformLocation(this->id, name.c_str()), value);
+    glProgramUniform1f(this->id, location(name), value);
+    count();
 }
 void Program::setVec2(std::string const &name, glm::vec2 const &value)
 {
-    glUniform2f(glGetUniformLocation(this->id, name.c_str()), value.x, value.y);
+    glProgramUniform2f(this->id, location(name), value.x, value.y);
+    count();
 }
 void Program::setVec2(std::string const &name, float v1, float v2)
 {
-    glUniform2f(glGetUniformLocation(this->id, name.c_str()), v1, v2);
+    glProgramUniform2f(this->id, location(name), v1, v2);
+    count();
+}
+void Program::setIVec2(std::string const &name, glm::ivec2 const &value)
+{
+    glProgramUniform2i(this->id, location(name), value.x, value.y);
+    count();
 }
 void Program::setVec3(std::string const &name, glm::vec3 const &value)
 {
-    glUniform3f(glGetUniformLocation(this->id, name.c_str()), value.x, value.y, value.z);
+    glProgramUniform3f(this->id, location(name), value.x, value.y, value.z);
+    count();
 }
 void Program::setVec3(std::string const &name, float v1, float v2, float v3)
 {
-    glUniform3f(glGetUniformLocation(this->id, name.c_str()), v1, v2, v3);
+    glProgramUniform3f(this->id, location(name), v1, v2, v3);
+    count();
 }
 void Program::setVec4(std::string const &name, glm::vec4 const &value)
 {
-    glUniform4f(glGetUniformLocation(this->id, name.c_str()), value.x, value.y, value.z, value.w);
+    glProgramUniform4f(this->id, location(name), value.x, value.y, value.z, value.w);
+    count();
 }
 void Program::setVec4(std::string const &name, float v1, float v2, float v3, float v4)
 {
-    glUniform4f(glGetUniformLocation(this->id, name.c_str()), v1, v2, v3, v4);
+    glProgramUniform4f(this->id, location(name), v1, v2, v3, v4);
+    count();
 }
 
-void Program::handleFileAction(efsw::WatchID watchid, const std::string &dir, const std::string &filename,
-                               efsw::Action action, std::string oldFilename)
+void Program::fileChanged(std::string const &filename)
 {
     for (auto const &s : includedFiles)
     {
-        if (s.compare(filename) == 0 && action == efsw::Actions::Add)
+        if (s.compare(filename) == 0)
         {
             spdlog::debug("Needs Recompile {}", filename);
             this->needsRecompile = true;
@@ -323,20 +899,204 @@ void Program::handleFileAction(efsw::WatchID watchid, const std::string &dir, co
     }
 }
 
-SSBO::SSBO()
+void Program::handleFileAction(efsw::WatchID watchid, const std::string &dir, const std::string &filename,
+                               efsw::Action action, std::string oldFilename)
 {
-    glGenBuffers(1, &this->id);
+    if (action != efsw::Actions::Add)
+    {
+        return;
+    }
+    if (onFileChanged)
+    {
+        onFileChanged(filename);
+    }
+    else
+    {
+        // includedFiles belongs to the render thread, without a handler recompile on any change
+        this->needsRecompile = true;
+    }
+}
+
+SSBO::SSBO(std::string const &label)
+{
+    this->id = createBuffer(label);
 }
 SSBO::~SSBO()
 {
-    glDeleteBuffers(1, &this->id);
+    deleteBuffer(this->id);
 }
 void SSBO::bind()
 {
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->id);
+    bindBuffer(GL_SHADER_STORAGE_BUFFER, this->id);
 }
 void SSBO::layout(GLint binding)
 {
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, this->id);
+    bindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, this->id);
+}
+
+/* PixelBuffer */
+
+PixelBuffer::PixelBuffer(std::string const &label)
+{
+    this->id = createBuffer(label);
+}
+PixelBuffer::~PixelBuffer()
+{
+    deleteBuffer(this->id);
+}
+void PixelBuffer::bind()
+{
+    bindBuffer(GL_PIXEL_PACK_BUFFER, this->id);
+}
+void PixelBuffer::allocate(size_t size)
+{
+    bufferData(this->id, GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+    this->size = size;
+}
+size_t PixelBuffer::getSize()
+{
+    return this->size;
+}
+void *PixelBuffer::map()
+{
+    count();
+    if (hasDirectStateAccess())
+    {
+        return dsa.mapNamedBufferRange(this->id, 0, this->size, GL_MAP_READ_BIT);
+    }
+    this->bind();
+    return glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, this->size, GL_MAP_READ_BIT);
+}
+void PixelBuffer::unmap()
+{
+    count();
+    if (hasDirectStateAccess())
+    {
+        dsa.unmapNamedBuffer(this->id);
+        return;
+    }
+    this->bind();
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+}
+
+/* Texture */
+
+Texture::Texture(int32_t width, int32_t height, std::string const &label) : width(width), height(height)
+{
+    glGenTextures(1, &this->id);
+    bindTexture(GL_TEXTURE_2D, this->id);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA32F, width, height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    count(4);
+    trackResource(ResourceType::Texture, this->id, label);
+    setResourceSize(ResourceType::Texture, this->id, size_t(width) * height * 4 * sizeof(float), GL_RGBA32F);
+}
+Texture::~Texture()
+{
+    deleteTexture(this->id);
+}
+int32_t Texture::getWidth()
+{
+    return this->width;
+}
+int32_t Texture::getHeight()
+{
+    return this->height;
+}
+void Texture::bind(GLuint unit)
+{
+    activeTexture(unit);
+    bindTexture(GL_TEXTURE_2D, this->id);
+}
+void Texture::bindImage(GLuint unit, GLenum access)
+{
+    glBindImageTexture(unit, this->id, 0, GL_FALSE, 0, access, GL_RGBA32F);
+    count();
+}
+std::vector<float> Texture::read()
+{
+    std::vector<float> pixels(size_t(width) * height * 4);
+    ez::bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    bindTexture(GL_TEXTURE_2D, this->id);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, pixels.data());
+    count();
+    return pixels;
+}
+void Texture::readToPixelBuffer()
+{
+    bindTexture(GL_TEXTURE_2D, this->id);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, nullptr);
+    count();
+}
+
+/* TimerQuery */
+
+TimerQuery::TimerQuery()
+{
+    glGenQueries(1, &this->id);
+    count();
+}
+TimerQuery::~TimerQuery()
+{
+    glDeleteQueries(1, &this->id);
+    count();
+}
+void TimerQuery::begin()
+{
+    glBeginQuery(GL_TIME_ELAPSED, this->id);
+    count();
+}
+void TimerQuery::end()
+{
+    glEndQuery(GL_TIME_ELAPSED);
+    count();
+}
+bool TimerQuery::available()
+{
+    GLint available = 0;
+    glGetQueryObjectiv(this->id, GL_QUERY_RESULT_AVAILABLE, &available);
+    count();
+    return available;
+}
+double TimerQuery::milliseconds()
+{
+    GLuint64 nanoseconds = 0;
+    glGetQueryObjectui64v(this->id, GL_QUERY_RESULT, &nanoseconds);
+    count();
+    return nanoseconds / 1e6;
+}
+
+/* TextureArray */
+
+TextureArray::TextureArray(int32_t width, int32_t height, int32_t layers, std::string const &label)
+    : width(width), height(height), layers(layers)
+{
+    glGenTextures(1, &this->id);
+    bindTexture(GL_TEXTURE_2D_ARRAY, this->id);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_RGBA32F, width, height, layers);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    count(4);
+    trackResource(ResourceType::Texture, this->id, label);
+    setResourceSize(ResourceType::Texture, this->id, size_t(width) * height * layers * 4 * sizeof(float), GL_RGBA32F);
+}
+TextureArray::~TextureArray()
+{
+    deleteTexture(this->id);
+}
+void TextureArray::bindImage(GLuint unit, GLenum access)
+{
+    glBindImageTexture(unit, this->id, 0, GL_TRUE, 0, access, GL_RGBA32F);
+    count();
+}
+std::vector<float> TextureArray::read()
+{
+    std::vector<float> pixels(size_t(width) * height * layers * 4);
+    ez::bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    bindTexture(GL_TEXTURE_2D_ARRAY, this->id);
+    glGetTexImage(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA, GL_FLOAT, pixels.data());
+    count();
+    return pixels;
 }
 } // namespace ez
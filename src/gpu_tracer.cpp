@@ -0,0 +1,106 @@
+#include "gpu_tracer.hpp"
+
+GpuTracer::GpuTracer(std::vector<Sphere> const &spheres, MeshBuffers const &meshes, TraceSettings const &settings)
+    : program({{GL_COMPUTE_SHADER, "shaders/tile.csh"}}), lights(lightIndices(spheres)), sphereSSBO("gpu spheres"),
+      lightSSBO("gpu lights"), meshSSBO("gpu meshes"), meshVertexSSBO("gpu mesh vertices"),
+      meshIndexSSBO("gpu mesh indices"), sphereCount(spheres.size()), meshCount(meshes.meshes.size()),
+      settings(settings)
+{
+    sphereSSBO.setData(spheres.data(), spheres.size());
+    lightSSBO.setData(lights.data(), lights.size());
+    meshSSBO.setData(meshes.meshes.data(), meshes.meshes.size());
+    meshVertexSSBO.setData(meshes.vertices.data(), meshes.vertices.size());
+    meshIndexSSBO.setData(meshes.indices.data(), meshes.indices.size());
+}
+
+void GpuTracer::setUniforms(TraceSettings const &trace)
+{
+    program.setFloat("viewport_height", trace.viewport_size);
+    program.setFloat("focal_length", trace.focal_length);
+    program.setFloat("camera_z", trace.camera_z);
+    program.setFloat("t_min", trace.t_min);
+    program.setFloat("t_max", trace.t_max);
+    program.setInt("max_ray_reflections", trace.max_ray_reflections);
+    program.setInt("samples", trace.samples);
+    program.setInt("light_sampling", trace.light_sampling);
+    program.setInt("numSpheres", sphereCount);
+    program.setInt("numLights", lights.size());
+    program.setInt("numMeshes", meshCount);
+}
+
+void GpuTracer::dispatch()
+{
+    sphereSSBO.layout(3);
+    lightSSBO.layout(4);
+    meshSSBO.layout(6);
+    meshVertexSSBO.layout(7);
+    meshIndexSSBO.layout(8);
+    frame->bindImage(0, GL_READ_WRITE);
+    int32_t width = frame->getWidth(), height = frame->getHeight();
+    program.setIVec2("tile_origin", glm::ivec2(0, 0));
+    program.setIVec2("tile_size", glm::ivec2(width, height));
+    program.dispatch((width + 7) / 8, (height + 7) / 8, 1);
+}
+
+void GpuTracer::reset(int32_t width, int32_t height)
+{
+    if (!frame || frame->getWidth() != width || frame->getHeight() != height)
+    {
+        frame = std::make_unique<ez::Texture>(width, height, "gpu frame");
+    }
+    passes = 0;
+}
+
+void GpuTracer::renderPass(uint32_t seed)
+{
+    setUniforms(settings);
+    program.setInt("seed", seed);
+    program.setInt("accumulated_passes", passes);
+    dispatch();
+    // The next pass reads what this one wrote
+    ez::memoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    glFinish();
+    passes++;
+}
+
+void GpuTracer::read(Image &image)
+{
+    ez::memoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+    std::vector<float> pixels = frame->read();
+    image = Image(frame->getWidth(), frame->getHeight());
+    for (size_t i = 0; i < image.pixels.size(); i++)
+    {
+        image.pixels[i] = glm::vec3(pixels[i * 4], pixels[i * 4 + 1], pixels[i * 4 + 2]);
+    }
+}
+
+double GpuTracer::intersectionThroughput(int32_t width, int32_t height)
+{
+    reset(width, height);
+    TraceSettings trace = settings;
+    trace.max_ray_reflections = 1;
+    trace.samples = 1;
+    trace.light_sampling = false;
+    setUniforms(trace);
+    program.setInt("seed", 0);
+    program.setInt("accumulated_passes", 0);
+
+    // Warm up so the timing doesn't pay for shader compilation on first use
+    dispatch();
+    glFinish();
+
+    ez::TimerQuery query;
+    double milliseconds = 0;
+    int32_t runs = 5;
+    for (int32_t i = 0; i < runs; i++)
+    {
+        query.begin();
+        dispatch();
+        query.end();
+        while (!query.available())
+        {
+        }
+        milliseconds += query.milliseconds();
+    }
+    return double(width) * height * runs / (milliseconds / 1000);
+}
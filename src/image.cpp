@@ -0,0 +1,307 @@
+#include "image.hpp"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <spdlog/spdlog.h>
+
+Image::Image(int32_t width, int32_t height) : width(width), height(height), pixels(width * height, glm::vec3(0))
+{
+}
+
+glm::vec3 &Image::at(int32_t x, int32_t y)
+{
+    return pixels[y * width + x];
+}
+
+glm::vec3 const &Image::at(int32_t x, int32_t y) const
+{
+    return pixels[y * width + x];
+}
+
+static uint8_t toByte(float v)
+{
+    return static_cast<uint8_t>(std::clamp(v, 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+bool writePPM(std::string const &path, Image const &image)
+{
+    std::ofstream stream(path, std::ios::binary);
+    if (not stream)
+    {
+        spdlog::error("Unable to open file {}", path);
+        return false;
+    }
+    stream << "P6\n" << image.width << " " << image.height << "\n255\n";
+    std::vector<uint8_t> bytes;
+    bytes.reserve(image.pixels.size() * 3);
+    for (auto const &p : image.pixels)
+    {
+        bytes.push_back(toByte(p.x));
+        bytes.push_back(toByte(p.y));
+        bytes.push_back(toByte(p.z));
+    }
+    stream.write(reinterpret_cast<char const *>(bytes.data()), bytes.size());
+    return stream.good();
+}
+
+static void putU32BE(std::vector<uint8_t> &out, uint32_t v)
+{
+    out.push_back(v >> 24);
+    out.push_back(v >> 16);
+    out.push_back(v >> 8);
+    out.push_back(v);
+}
+
+template <typename T> static void putLE(std::vector<uint8_t> &out, T v)
+{
+    uint8_t bytes[sizeof(T)];
+    std::memcpy(bytes, &v, sizeof(T));
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+static void putString(std::vector<uint8_t> &out, std::string_view s)
+{
+    out.insert(out.end(), s.begin(), s.end());
+    out.push_back(0);
+}
+
+static uint32_t crc32(uint8_t const *data, size_t size, uint32_t crc = 0)
+{
+    static auto const table = []() {
+        std::array<uint32_t, 256> t;
+        for (uint32_t n = 0; n < 256; n++)
+        {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++)
+            {
+                c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+            t[n] = c;
+        }
+        return t;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+    {
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static void putChunk(std::vector<uint8_t> &out, char const *type, std::vector<uint8_t> const &data)
+{
+    putU32BE(out, data.size());
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    putU32BE(out, crc32(out.data() + start, out.size() - start));
+}
+
+static bool writeBytes(std::string const &path, std::vector<uint8_t> const &bytes)
+{
+    std::ofstream stream(path, std::ios::binary);
+    if (not stream)
+    {
+        spdlog::error("Unable to open file {}", path);
+        return false;
+    }
+    stream.write(reinterpret_cast<char const *>(bytes.data()), bytes.size());
+    return stream.good();
+}
+
+bool writePNG(std::string const &path, Image const &image)
+{
+    // Raw scanlines with filter type 0
+    std::vector<uint8_t> raw;
+    raw.reserve((image.width * 3 + 1) * image.height);
+    for (int32_t y = 0; y < image.height; y++)
+    {
+        raw.push_back(0);
+        for (int32_t x = 0; x < image.width; x++)
+        {
+            glm::vec3 const &p = image.at(x, y);
+            raw.push_back(toByte(p.x));
+            raw.push_back(toByte(p.y));
+            raw.push_back(toByte(p.z));
+        }
+    }
+
+    // zlib stream made of stored deflate blocks
+    std::vector<uint8_t> zlib = {0x78, 0x01};
+    size_t offset = 0;
+    do
+    {
+        uint16_t len = std::min<size_t>(raw.size() - offset, 65535);
+        bool last = offset + len == raw.size();
+        zlib.push_back(last ? 1 : 0);
+        putLE<uint16_t>(zlib, len);
+        putLE<uint16_t>(zlib, ~len);
+        zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + len);
+        offset += len;
+    } while (offset < raw.size());
+    uint32_t a = 1, b = 0;
+    for (uint8_t v : raw)
+    {
+        a = (a + v) % 65521;
+        b = (b + a) % 65521;
+    }
+    putU32BE(zlib, (b << 16) | a);
+
+    std::vector<uint8_t> header;
+    putU32BE(header, image.width);
+    putU32BE(header, image.height);
+    header.insert(header.end(), {8, 2, 0, 0, 0}); // 8 bit RGB, no interlace
+
+    std::vector<uint8_t> out = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    putChunk(out, "IHDR", header);
+    putChunk(out, "IDAT", zlib);
+    putChunk(out, "IEND", {});
+    return writeBytes(path, out);
+}
+
+bool writeEXR(std::string const &path, Image const &image)
+{
+    std::vector<uint8_t> out;
+    putLE<uint32_t>(out, 20000630);
+    putLE<uint32_t>(out, 2);
+
+    // Channels have to be sorted by name
+    putString(out, "channels");
+    putString(out, "chlist");
+    putLE<uint32_t>(out, 3 * 18 + 1);
+    for (char const *name : {"B", "G", "R"})
+    {
+        putString(out, name);
+        putLE<int32_t>(out, 2); // FLOAT
+        putLE<uint32_t>(out, 0);
+        putLE<int32_t>(out, 1);
+        putLE<int32_t>(out, 1);
+    }
+    out.push_back(0);
+
+    putString(out, "compression");
+    putString(out, "compression");
+    putLE<uint32_t>(out, 1);
+    out.push_back(0);
+
+    for (char const *window : {"dataWindow", "displayWindow"})
+    {
+        putString(out, window);
+        putString(out, "box2i");
+        putLE<uint32_t>(out, 16);
+        putLE<int32_t>(out, 0);
+        putLE<int32_t>(out, 0);
+        putLE<int32_t>(out, image.width - 1);
+        putLE<int32_t>(out, image.height - 1);
+    }
+
+    putString(out, "lineOrder");
+    putString(out, "lineOrder");
+    putLE<uint32_t>(out, 1);
+    out.push_back(0);
+
+    putString(out, "pixelAspectRatio");
+    putString(out, "float");
+    putLE<uint32_t>(out, 4);
+    putLE<float>(out, 1.0f);
+
+    putString(out, "screenWindowCenter");
+    putString(out, "v2f");
+    putLE<uint32_t>(out, 8);
+    putLE<float>(out, 0.0f);
+    putLE<float>(out, 0.0f);
+
+    putString(out, "screenWindowWidth");
+    putString(out, "float");
+    putLE<uint32_t>(out, 4);
+    putLE<float>(out, 1.0f);
+    out.push_back(0);
+
+    // One scanline per block without compression
+    uint32_t lineSize = image.width * 3 * sizeof(float);
+    uint64_t blockStart = out.size() + image.height * sizeof(uint64_t);
+    for (int32_t y = 0; y < image.height; y++)
+    {
+        putLE<uint64_t>(out, blockStart + uint64_t(y) * (lineSize + 8));
+    }
+    for (int32_t y = 0; y < image.height; y++)
+    {
+        putLE<int32_t>(out, y);
+        putLE<uint32_t>(out, lineSize);
+        for (int c : {2, 1, 0})
+        {
+            for (int32_t x = 0; x < image.width; x++)
+            {
+                putLE<float>(out, image.at(x, y)[c]);
+            }
+        }
+    }
+    return writeBytes(path, out);
+}
+
+bool writePFM(std::string const &path, Image const &image)
+{
+    std::ofstream stream(path, std::ios::binary);
+    if (not stream)
+    {
+        spdlog::error("Unable to open file {}", path);
+        return false;
+    }
+    // Negative scale means little endian, rows go bottom to top
+    stream << "PF\n" << image.width << " " << image.height << "\n-1.0\n";
+    for (int32_t y = image.height - 1; y >= 0; y--)
+    {
+        stream.write(reinterpret_cast<char const *>(&image.at(0, y)), sizeof(glm::vec3) * image.width);
+    }
+    return stream.good();
+}
+
+bool readPFM(std::string const &path, Image &image)
+{
+    std::ifstream stream(path, std::ios::binary);
+    if (not stream)
+    {
+        return false;
+    }
+    std::string magic;
+    int32_t width = 0, height = 0;
+    float scale = 0;
+    stream >> magic >> width >> height >> scale;
+    stream.get();
+    if (magic != "PF" || width <= 0 || height <= 0 || scale >= 0)
+    {
+        spdlog::error("{} is not a little endian RGB float map", path);
+        return false;
+    }
+    image = Image(width, height);
+    for (int32_t y = height - 1; y >= 0; y--)
+    {
+        stream.read(reinterpret_cast<char *>(&image.at(0, y)), sizeof(glm::vec3) * width);
+    }
+    if (not stream)
+    {
+        spdlog::error("{} is truncated", path);
+        return false;
+    }
+    return true;
+}
+
+bool writeImage(std::string const &path, Image const &image)
+{
+    std::string extension = std::filesystem::path(path).extension().string();
+    if (extension == ".png")
+    {
+        return writePNG(path, image);
+    }
+    if (extension == ".exr")
+    {
+        return writeEXR(path, image);
+    }
+    if (extension == ".pfm")
+    {
+        return writePFM(path, image);
+    }
+    return writePPM(path, image);
+}
@@ -1,5 +1,9 @@
+#include <algorithm>
 #include <exception>
+#include <filesystem>
+#include <functional>
 #include <memory>
+#include <thread>
 #include <vector>
 #define GLAD_GL_IMPLEMENTATION
 #define GLFW_INCLUDE_NONE
@@ -16,7 +20,18 @@
 #endif
 #include "imgui.h"
 
+#include "capture.hpp"
+#include "commands.hpp"
+#include "convergence.hpp"
+#include "cpu_tracer.hpp"
+#include "distributed.hpp"
 #include "ezgl.hpp"
+#include "gpu_tracer.hpp"
+#include "image.hpp"
+#include "mesh.hpp"
+#include "scene.hpp"
+#include "sweep.hpp"
+#include "tile_scheduler.hpp"
 
 using namespace glm;
 
@@ -37,175 +52,708 @@ struct Vertex
     }
 };
 
-struct Sphere
+struct GlobalData : TraceSettings
 {
-    alignas(16) glm::vec3 origin;
-    alignas(16) glm::vec3 color;
-    float radius;
-
-    Sphere(glm::vec3 origin, float radius, glm::vec3 color = glm::vec3(0.7, 0.7, 0.7))
-    {
-        this->origin = origin;
-        this->radius = radius;
-        this->color = color;
-    }
-};
-
-struct GlobalData
-{
-    float viewport_size = 2.0;
-    float focal_length = 7.0;
-    float camera_z = 17.0;
-    float t_min = 0.1;
-    float t_max = 100.0;
-    int max_ray_reflections = 3;
-    int samples = 1;
     std::vector<Sphere> spheres;
     std::unique_ptr<ez::Program> program = NULL;
 };
 
+// The queue is bounded, a full one drops the command instead of blocking the render thread that drains it
+static void post(Commands &commands, Command const &command)
+{
+    if (!commands.push(command))
+    {
+        spdlog::warn("Command queue is full, dropped command {}", command.index());
+    }
+}
+
 static void key_callback(GLFWwindow *window, int32_t key, int32_t scancode, int32_t action, int32_t mods)
 {
-    GlobalData *data = (GlobalData *)glfwGetWindowUserPointer(window);
+    Commands *commands = (Commands *)glfwGetWindowUserPointer(window);
     if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
     {
         glfwSetWindowShouldClose(window, GLFW_TRUE);
     }
     if (key == GLFW_KEY_R && action == GLFW_PRESS)
     {
-        try
-        {
-            data->program->recompile();
-        }
-        catch (std::exception e)
-        {
-            spdlog::error("Couldn't compile Shaders\n{}", e.what());
-        }
+        post(*commands, RecompileShaders{});
     }
 }
 
 void scroll_callback(GLFWwindow *window, double xoffset, double yoffset)
 {
-    GlobalData *data = (GlobalData *)glfwGetWindowUserPointer(window);
-    data->camera_z += yoffset;
+    Commands *commands = (Commands *)glfwGetWindowUserPointer(window);
+    post(*commands, MoveCamera{float(yoffset)});
 }
 
-int main()
+int main(int argc, char **argv)
 {
     // spdlog::set_level(spdlog::level::debug);
+    GlobalData globaldata;
+    std::string sceneName = "default";
+    bool sceneGiven = false;
+    std::string cpuOutput;
+    std::string recordDirectory = "capture";
+    std::string recordFormat = "png";
+    bool recording = false;
+    std::string sweepPath;
+    // Defaults to the name of the mode that writes into it
+    std::string outputDirectory;
+    bool convergence = false;
+    // Tracer under test, "gpu" for tile.csh or "cpu" for the CpuTracer
+    std::string convergenceTracer = "gpu";
+    ConvergenceOptions convergenceOptions;
+    DistributedOptions distributed;
+    uint32_t scalingWorkers = 0;
+    std::vector<std::string> meshPaths;
+    bool meshBenchmark = false;
+    int32_t width = 1280, height = 720;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--scene" && i + 1 < argc)
+        {
+            sceneName = argv[++i];
+            sceneGiven = true;
+        }
+        else if (arg == "--cpu" && i + 1 < argc)
+        {
+            cpuOutput = argv[++i];
+        }
+        else if (arg == "--record" && i + 1 < argc)
+        {
+            recordDirectory = argv[++i];
+            recording = true;
+        }
+        else if (arg == "--format" && i + 1 < argc)
+        {
+            recordFormat = argv[++i];
+            if (recordFormat != "png" && recordFormat != "ppm" && recordFormat != "exr")
+            {
+                spdlog::error("Unknown image format {}", recordFormat);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (arg == "--sweep" && i + 1 < argc)
+        {
+            sweepPath = argv[++i];
+        }
+        else if (arg == "--output" && i + 1 < argc)
+        {
+            outputDirectory = argv[++i];
+        }
+        else if (arg == "--mesh" && i + 1 < argc)
+        {
+            meshPaths.push_back(argv[++i]);
+        }
+        else if (arg == "--mesh-benchmark")
+        {
+            meshBenchmark = true;
+        }
+        else if (arg == "--convergence")
+        {
+            convergence = true;
+        }
+        else if (arg == "--tracer" && i + 1 < argc)
+        {
+            convergenceTracer = argv[++i];
+            if (convergenceTracer != "gpu" && convergenceTracer != "cpu")
+            {
+                spdlog::error("Unknown tracer {}, has to be gpu or cpu", convergenceTracer);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (arg == "--duration" && i + 1 < argc)
+        {
+            convergenceOptions.durationSeconds = std::stod(argv[++i]);
+            if (convergenceOptions.durationSeconds <= 0)
+            {
+                spdlog::error("Duration has to be positive");
+                return EXIT_FAILURE;
+            }
+        }
+        else if (arg == "--interval" && i + 1 < argc)
+        {
+            convergenceOptions.intervalSeconds = std::stod(argv[++i]);
+            if (convergenceOptions.intervalSeconds <= 0)
+            {
+                spdlog::error("Interval has to be positive");
+                return EXIT_FAILURE;
+            }
+        }
+        else if (arg == "--reference-samples" && i + 1 < argc)
+        {
+            convergenceOptions.referenceSamples = std::stoi(argv[++i]);
+        }
+        else if (arg == "--no-light-sampling")
+        {
+            globaldata.light_sampling = false;
+        }
+        else if (arg == "--distribute" && i + 1 < argc)
+        {
+            distributed.address = argv[++i];
+        }
+        else if (arg == "--local-workers" && i + 1 < argc)
+        {
+            distributed.localWorkers = std::stoi(argv[++i]);
+        }
+        else if (arg == "--threads" && i + 1 < argc)
+        {
+            distributed.workerThreads = std::stoi(argv[++i]);
+        }
+        else if (arg == "--scaling" && i + 1 < argc)
+        {
+            scalingWorkers = std::stoi(argv[++i]);
+        }
+        else if (arg == "--worker" && i + 1 < argc)
+        {
+            std::string address = argv[++i];
+            // Optional --threads after the address
+            uint32_t threads = 0;
+            if (i + 2 < argc && std::string(argv[i + 1]) == "--threads")
+            {
+                threads = std::stoi(argv[i + 2]);
+            }
+            return runWorker(address, threads);
+        }
+        else if (arg == "--size" && i + 1 < argc)
+        {
+            if (sscanf(argv[++i], "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0)
+            {
+                spdlog::error("Size has to look like 1280x720");
+                return EXIT_FAILURE;
+            }
+        }
+        else if (arg == "--samples" && i + 1 < argc)
+        {
+            globaldata.samples = std::stoi(argv[++i]);
+        }
+        else if (arg == "--reflections" && i + 1 < argc)
+        {
+            globaldata.max_ray_reflections = std::stoi(argv[++i]);
+        }
+        else
+        {
+            spdlog::error("Unknown argument {}", arg);
+            return EXIT_FAILURE;
+        }
+    }
+    std::vector<Sphere> spheres = sceneByName(sceneName);
+
+    // Meshes are lined up along x around the origin, two units across each
+    std::vector<Mesh> meshes(meshPaths.size());
+    for (uint32_t i = 0; i < meshPaths.size(); i++)
+    {
+        if (!loadMesh(meshPaths[i], meshes[i]))
+        {
+            return EXIT_FAILURE;
+        }
+        fitMesh(meshes[i], glm::vec3((i - (meshPaths.size() - 1) / 2.0f) * 2.5f, 0, 0), 2.0f);
+    }
+    MeshBuffers meshBuffers = packMeshes(meshes);
+    if (meshBuffers.triangleCount() > 0)
+    {
+        // Plain float positions and normals would take 24 bytes per vertex instead of 12
+        size_t unpacked = meshBuffers.bytes() + meshBuffers.vertices.size() * sizeof(uint32_t);
+        double perMillion = 1e6 / meshBuffers.triangleCount() / (1 << 20);
+        spdlog::info("Meshes: {} triangles, {:.2f} MB, {:.1f} MB per million triangles ({:.1f} MB unquantised)",
+                     meshBuffers.triangleCount(), meshBuffers.bytes() / double(1 << 20),
+                     meshBuffers.bytes() * perMillion, unpacked * perMillion);
+    }
+    if (meshBenchmark)
+    {
+        double rays = CpuTracer(spheres, meshBuffers, globaldata).intersectionThroughput(width, height);
+        spdlog::info("CPU: {:.2f} M closest hit queries/s against {} triangles", rays / 1e6,
+                     meshBuffers.triangleCount());
+    }
+
+    // Render once with the CPU tracer without opening a window
+    if (!cpuOutput.empty() && distributed.address.empty())
+    {
+        Image image(width, height);
+        CpuTracer(spheres, meshBuffers, globaldata).render(image);
+        return writeImage(cpuOutput, image) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // Same, but the tiles are traced by worker processes
+    if (!cpuOutput.empty())
+    {
+        Image image(width, height);
+        DistributedStats stats;
+        if (scalingWorkers == 0)
+        {
+            if (!renderDistributed(spheres, meshBuffers, globaldata, image, distributed, stats))
+            {
+                return EXIT_FAILURE;
+            }
+            spdlog::info("{} workers, {:.3f} s, {} failed, {} tiles stolen", stats.workers, stats.seconds,
+                         stats.failures, stats.stolen);
+            for (uint32_t i = 0; i < stats.tilesPerWorker.size(); i++)
+            {
+                spdlog::info("Worker {}: {} tiles", i, stats.tilesPerWorker[i]);
+            }
+        }
+
+        // Strong scaling over 1..N local workers, efficiency is T1 / (N * TN). Without --threads the cores are
+        // split between the workers, otherwise every worker would use all of them and the run measures contention.
+        double baseline = 0;
+        uint32_t cores = std::max(1u, std::thread::hardware_concurrency());
+        uint32_t fixedThreads = distributed.workerThreads;
+        for (uint32_t workers = 1; workers <= scalingWorkers; workers++)
+        {
+            distributed.localWorkers = workers;
+            distributed.workerThreads = fixedThreads ? fixedThreads : std::max(1u, cores / workers);
+            if (!renderDistributed(spheres, meshBuffers, globaldata, image, distributed, stats))
+            {
+                return EXIT_FAILURE;
+            }
+            baseline = workers == 1 ? stats.seconds : baseline;
+            double speedup = baseline / stats.seconds;
+            spdlog::info("{} workers x {} threads: {:.3f} s, speedup {:.2f}, efficiency {:.0f}%", workers,
+                         distributed.workerThreads, stats.seconds, speedup, 100 * speedup / workers);
+        }
+        return writeImage(cpuOutput, image) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // Error against a reference over render time for the given scene or every scene
+    if (convergence)
+    {
+        outputDirectory = outputDirectory.empty() ? "convergence" : outputDirectory;
+        convergenceOptions.referenceDirectory = outputDirectory + "/reference";
+        std::filesystem::create_directories(outputDirectory);
+        std::vector<std::string> names = sceneGiven ? std::vector<std::string>{sceneName} : sceneNames();
+        // Only for its GL context, destroyed after the tracers below
+        std::unique_ptr<Window> context;
+        if (convergenceTracer == "gpu")
+        {
+            glfwSetErrorCallback(error_callback);
+            context = std::make_unique<Window>(1280, 720, "Ray Tracer");
+        }
+        for (std::string const &name : names)
+        {
+            std::vector<Sphere> sceneSpheres = sceneByName(name);
+            Image reference;
+            if (!loadReference(name, sceneSpheres, meshBuffers, globaldata, width, height, convergenceOptions,
+                               reference))
+            {
+                return EXIT_FAILURE;
+            }
+            std::unique_ptr<CpuTracer> cpuTracer;
+            std::unique_ptr<GpuTracer> gpuTracer;
+            PassRenderer renderer;
+            if (context)
+            {
+                gpuTracer = std::make_unique<GpuTracer>(sceneSpheres, meshBuffers, globaldata);
+                gpuTracer->reset(width, height);
+                renderer.render = [&](uint32_t pass) { gpuTracer->renderPass(pass); };
+                renderer.estimate = [&](Image &image) { gpuTracer->read(image); };
+            }
+            else
+            {
+                cpuTracer = std::make_unique<CpuTracer>(sceneSpheres, meshBuffers, globaldata);
+                renderer = cpuPassRenderer(*cpuTracer, width, height);
+            }
+            auto curve = measureConvergence(reference, globaldata.samples, renderer, convergenceOptions);
+            if (curve.empty())
+            {
+                spdlog::error("{}: no pass finished", name);
+                return EXIT_FAILURE;
+            }
+            ConvergenceSample const &last = curve.back();
+            spdlog::info("{}: {} spp in {:.2f} s, rmse {:.5f}, relMSE {:.5f}", name, last.samples, last.seconds,
+                         last.rmse, last.relMse);
+            std::string path = fmt::format("{}/{}_{}_{}", outputDirectory, name, convergenceTracer,
+                                           globaldata.light_sampling ? "nee" : "bsdf");
+            if (!writeConvergence(path, name, convergenceTracer, globaldata, curve))
+            {
+                return EXIT_FAILURE;
+            }
+        }
+        return EXIT_SUCCESS;
+    }
+
     // Initialized GLFW
     glfwSetErrorCallback(error_callback);
 
     // Create a Window
     Window window(1280, 720, "Ray Tracer");
 
+    if (meshBenchmark)
+    {
+        double rays = GpuTracer(spheres, meshBuffers, globaldata).intersectionThroughput(width, height);
+        spdlog::info("GPU: {:.2f} M closest hit queries/s against {} triangles", rays / 1e6,
+                     meshBuffers.triangleCount());
+        return EXIT_SUCCESS;
+    }
+
+    // Render all parameter sets in one dispatch, write them out and quit
+    if (!sweepPath.empty())
+    {
+        std::vector<SweepParams> sweep = loadSweep(sweepPath, globaldata);
+        SweepResult result = renderSweep(sweep, spheres, meshBuffers, width, height, true);
+        spdlog::info("Batched: {:.3f} s, {:.2f} images/s", result.batchedSeconds,
+                     sweep.size() / result.batchedSeconds);
+        spdlog::info("One after another: {:.3f} s, {:.2f} images/s", result.sequentialSeconds,
+                     sweep.size() / result.sequentialSeconds);
+        ez::logMemoryUsage();
+
+        outputDirectory = outputDirectory.empty() ? "sweep" : outputDirectory;
+        std::filesystem::create_directories(outputDirectory);
+        for (uint32_t i = 0; i < result.images.size(); i++)
+        {
+            std::string path = fmt::format("{}/sweep_{:03d}.{}", outputDirectory, i, recordFormat);
+            if (!writeImage(path, result.images[i]))
+            {
+                return EXIT_FAILURE;
+            }
+        }
+        return EXIT_SUCCESS;
+    }
+
     // Set callback
     window.setKeyCallback(key_callback);
     window.setScrollCallback(scroll_callback);
 
-    std::vector<Vertex> vertices = {
-        Vertex(glm::vec3(1.0f, -1.0f, 0.0f), glm::vec2(1.0f, 1.0f)),  // top right
-        Vertex(glm::vec3(1.0f, 1.0f, 0.0f), glm::vec2(1.0f, 0.0f)),   // bottom right
-        Vertex(glm::vec3(-1.0f, -1.0f, 0.0f), glm::vec2(0.0f, 1.0f)), // top left
-        Vertex(glm::vec3(1.0f, 1.0f, 0.0f), glm::vec2(1.0f, 0.0f)),   // bottom right
-        Vertex(glm::vec3(-1.0f, -1.0f, 0.0f), glm::vec2(0.0f, 1.0f)), // top left
-        Vertex(glm::vec3(-1.0f, 1.0f, 0.0f), glm::vec2(0.0f, 0.0f)),  // top right
-    };
-
-    ez::VertexBuffer quad_vbo;
-    quad_vbo.setData(vertices.data(), vertices.size());
-
-    ez::VertexArray vao;
-    quad_vbo.bind();
-    vao.attributes({
-        {GL_FLOAT, 3},
-        {GL_FLOAT, 2}
-    });
-
-    // ImGui Variables
-    GlobalData globaldata;
-    globaldata.program = std::make_unique<ez::Program>("shaders/quad.vsh", "shaders/quad.fsh", true);
-    window.setUserPointer(&globaldata);
-    double lastTime = glfwGetTime();
-    std::vector<Sphere> spheres;
-    spheres.push_back(Sphere(glm::vec3(0, -0.2, 5), 1.0, glm::vec3(1, 0, 0)));
-    spheres.push_back(Sphere(glm::vec3(0, -51, 0), 50, glm::vec3(0, 1, 0)));
-    spheres.push_back(Sphere(glm::vec3(2, 0, 0), 0.3, glm::vec3(0, 0, 1)));
-    ez::SSBO sphereSSBO;
-    sphereSSBO.setData(spheres.data(), spheres.size());
-
-    while (!window.shouldClose())
+    // The viewer's GL objects live in this scope, so the memory report after it only shows leaks
     {
-        double time = glfwGetTime();
-        // window.setClearColor(sin(time), -sin(time), 0, 1);
-
-        // START RENDERING
-        window.startDrawing();
-
-        globaldata.program.get()->use();
-        globaldata.program.get()->setFloat("window_width", window.width);
-        globaldata.program.get()->setFloat("window_height", window.height);
-        globaldata.program.get()->setFloat("viewport_height", globaldata.viewport_size);
-        globaldata.program.get()->setFloat("focal_length", globaldata.focal_length);
-        globaldata.program.get()->setFloat("camera_z", globaldata.camera_z);
-        globaldata.program.get()->setFloat("t_min", globaldata.t_min);
-        globaldata.program.get()->setInt("numSpheres", spheres.size());
-        globaldata.program.get()->setInt("max_ray_reflections", globaldata.max_ray_reflections);
-        globaldata.program.get()->setInt("samples", globaldata.samples);
-        globaldata.program.get()->setFloat("t_max", globaldata.t_max);
-        globaldata.program.get()->setFloat("frameTime", glfwGetTime() - lastTime);
-        globaldata.program.get()->setFloat("globalTime", glfwGetTime());
-
-        sphereSSBO.bind();
-        sphereSSBO.layout(3);
-        vao.bind();
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-
-        ImGui::Begin("<3");
-
-        ImGui::Text("%f", 1 / (glfwGetTime() - lastTime));
-        lastTime = glfwGetTime();
-        ImGui::SliderFloat("Viewport Size", &globaldata.viewport_size, 1.0, 10.0);
-        ImGui::SliderFloat("Focal Length", &globaldata.focal_length, 1.0, 50.0);
-        ImGui::SliderFloat("Camera Z", &globaldata.camera_z, 0.0, 50.0);
-        ImGui::SliderFloat("Min Clip", &globaldata.t_min, 0.0, 10.0);
-        ImGui::SliderFloat("Max Clip", &globaldata.t_max, 10.0, 100.0);
-        ImGui::SliderInt("Max Reflections", &globaldata.max_ray_reflections, 1, 100);
-        ImGui::SliderInt("Max Samples", &globaldata.samples, 1, 100);
-        if (ImGui::Button("Add Sphere", ImVec2(30, 30)))
-        {
-            spheres.push_back(Sphere(glm::vec3(0, 0, 0), 1.0));
-            sphereSSBO.setData(spheres.data(), spheres.size());
-        }
-
-        for (uint32_t i = 0; i < spheres.size(); i++)
-        {
-            ImGui::PushID(i);
-            if (ImGui::Button("Delete"))
-            {
-                spheres.erase(spheres.begin() + i);
+        std::vector<Vertex> vertices = {
+            Vertex(glm::vec3(1.0f, -1.0f, 0.0f), glm::vec2(1.0f, 1.0f)),  // top right
+            Vertex(glm::vec3(1.0f, 1.0f, 0.0f), glm::vec2(1.0f, 0.0f)),   // bottom right
+            Vertex(glm::vec3(-1.0f, -1.0f, 0.0f), glm::vec2(0.0f, 1.0f)), // top left
+            Vertex(glm::vec3(1.0f, 1.0f, 0.0f), glm::vec2(1.0f, 0.0f)),   // bottom right
+            Vertex(glm::vec3(-1.0f, -1.0f, 0.0f), glm::vec2(0.0f, 1.0f)), // top left
+            Vertex(glm::vec3(-1.0f, 1.0f, 0.0f), glm::vec2(0.0f, 0.0f)),  // top right
+        };
+
+        ez::VertexBuffer quad_vbo(false, "quad");
+        quad_vbo.setData(vertices.data(), vertices.size());
+
+        ez::VertexArray vao;
+        vao.attributes(quad_vbo, {
+            {GL_FLOAT, 3},
+            {GL_FLOAT, 2}
+        });
+
+        // Filled by the file watcher and input callbacks, drained by the render loop
+        Commands commands;
+        window.setUserPointer(&commands);
+
+        // ImGui Variables
+        globaldata.program = std::make_unique<ez::Program>(
+            "shaders/quad.vsh", "shaders/quad.fsh", true,
+            [&commands](std::string const &filename) { post(commands, ShaderFileChanged(filename)); });
+        double lastTime = glfwGetTime();
+        ez::SSBO sphereSSBO("spheres");
+        sphereSSBO.setData(spheres.data(), spheres.size());
+        std::vector<int32_t> lights = lightIndices(spheres);
+        ez::SSBO lightSSBO("lights");
+        lightSSBO.setData(lights.data(), lights.size());
+        ez::SSBO meshSSBO("meshes"), meshVertexSSBO("mesh vertices"), meshIndexSSBO("mesh indices");
+        meshSSBO.setData(meshBuffers.meshes.data(), meshBuffers.meshes.size());
+        meshVertexSSBO.setData(meshBuffers.vertices.data(), meshBuffers.vertices.size());
+        meshIndexSSBO.setData(meshBuffers.indices.data(), meshBuffers.indices.size());
+        std::unique_ptr<FrameCapture> capture;
+        ez::CallStats glStats;
+
+        // Tiled rendering traces into frameTexture over as many frames as the budget needs
+        ez::Program tileProgram({{GL_COMPUTE_SHADER, "shaders/tile.csh"}});
+        ez::Program presentProgram("shaders/quad.vsh", "shaders/present.fsh");
+        std::vector<ez::Program *> programs = {globaldata.program.get(), &tileProgram, &presentProgram};
+        std::unique_ptr<ez::Texture> frameTexture;
+        TileScheduler scheduler;
+        bool tiled = true;
+        uint64_t sceneVersion = 0;
+        struct FrameKey
+        {
+            TraceSettings settings;
+            uint64_t sceneVersion;
+            uint32_t shaderGeneration;
+            int32_t width, height;
+            bool operator==(FrameKey const &) const = default;
+        };
+        FrameKey lastFrame{};
+
+        auto setTraceUniforms = [&](ez::Program &program) {
+            program.setFloat("window_width", window.width);
+            program.setFloat("window_height", window.height);
+            program.setFloat("viewport_height", globaldata.viewport_size);
+            program.setFloat("focal_length", globaldata.focal_length);
+            program.setFloat("camera_z", globaldata.camera_z);
+            program.setFloat("t_min", globaldata.t_min);
+            program.setInt("numSpheres", spheres.size());
+            program.setInt("max_ray_reflections", globaldata.max_ray_reflections);
+            program.setInt("samples", globaldata.samples);
+            program.setInt("numLights", lights.size());
+            program.setInt("numMeshes", meshBuffers.meshes.size());
+            program.setInt("light_sampling", globaldata.light_sampling);
+            program.setFloat("t_max", globaldata.t_max);
+            program.setFloat("frameTime", glfwGetTime() - lastTime);
+            program.setFloat("globalTime", glfwGetTime());
+        };
+
+        while (!window.shouldClose())
+        {
+            double time = glfwGetTime();
+            // window.setClearColor(sin(time), -sin(time), 0, 1);
+
+            // START RENDERING
+            window.startDrawing();
+
+            // Apply everything posted since the last frame, scene edits end up in a single upload
+            bool spheresResized = false;
+            uint32_t dirtyBegin = UINT32_MAX, dirtyEnd = 0;
+            // Indices in one batch all refer to the spheres as the UI saw them, so removals wait until the end
+            std::vector<uint32_t> removed;
+            commands.drain([&](Command const &command) {
+                std::visit(overloaded{
+                               [&](RecompileShaders const &) {
+                                   for (ez::Program *program : programs)
+                                   {
+                                       program->recompile();
+                                   }
+                               },
+                               [&](ShaderFileChanged const &c) {
+                                   for (ez::Program *program : programs)
+                                   {
+                                       program->fileChanged(c.filename);
+                                   }
+                               },
+                               [&](MoveCamera const &c) { globaldata.camera_z += c.dz; },
+                               [&](AddSphere const &c) {
+                                   spheres.push_back(c.sphere);
+                                   spheresResized = true;
+                               },
+                               [&](UpdateSphere const &c) {
+                                   if (c.index < spheres.size())
+                                   {
+                                       spheres[c.index] = c.sphere;
+                                       dirtyBegin = std::min(dirtyBegin, c.index);
+                                       dirtyEnd = std::max(dirtyEnd, c.index + 1);
+                                   }
+                               },
+                               [&](RemoveSphere const &c) { removed.push_back(c.index); },
+                           },
+                           command);
+            });
+            // Highest index first so an erase never shifts one still to come
+            std::sort(removed.begin(), removed.end(), std::greater<uint32_t>());
+            removed.erase(std::unique(removed.begin(), removed.end()), removed.end());
+            for (uint32_t index : removed)
+            {
+                if (index < spheres.size())
+                {
+                    spheres.erase(spheres.begin() + index);
+                    spheresResized = true;
+                }
+            }
+            if (spheresResized)
+            {
                 sphereSSBO.setData(spheres.data(), spheres.size());
             }
-            ImGui::SameLine();
-            if (ImGui::CollapsingHeader("Sphere"))
+            else if (dirtyBegin < dirtyEnd)
+            {
+                sphereSSBO.setSubData(spheres.data(), dirtyBegin, dirtyEnd - dirtyBegin);
+            }
+            if (spheresResized || dirtyBegin < dirtyEnd)
             {
-                bool positionUpdated = ImGui::SliderFloat3("Position", &spheres[i].origin.x, -5, 5);
-                bool radiusUpdated = ImGui::SliderFloat("Radius", &spheres[i].radius, -2, 2);
-                bool colorUpdated = ImGui::ColorPicker3("Color", &spheres[i].color.x);
-                if (positionUpdated || colorUpdated || radiusUpdated)
+                sceneVersion++;
+                std::vector<int32_t> newLights = lightIndices(spheres);
+                if (newLights != lights)
                 {
-                    sphereSSBO.setSubData(spheres.data(), i, 1);
+                    lights = newLights;
+                    lightSSBO.setData(lights.data(), lights.size());
                 }
             }
 
-            ImGui::PopID();
-        }
-        ImGui::End();
+            sphereSSBO.layout(3);
+            lightSSBO.layout(4);
+            meshSSBO.layout(6);
+            meshVertexSSBO.layout(7);
+            meshIndexSSBO.layout(8);
+            // EXR frames are read from the float frame texture, only the tiled path renders into one
+            if (recording && recordFormat == "exr")
+            {
+                tiled = true;
+            }
+            if (tiled && window.width > 0 && window.height > 0)
+            {
+                // Picks up pending recompiles before the generation is compared and uniforms are set
+                tileProgram.use();
+                if (!frameTexture || frameTexture->getWidth() != window.width ||
+                    frameTexture->getHeight() != window.height)
+                {
+                    frameTexture = std::make_unique<ez::Texture>(window.width, window.height, "tiled frame");
+                }
 
-        window.endDrawing();
+                // Start the image over whenever anything that shows up in it changed
+                FrameKey frame{globaldata, sceneVersion, tileProgram.getGeneration(), window.width, window.height};
+                if (frame != lastFrame)
+                {
+                    bool costChanged = frame.settings.samples != lastFrame.settings.samples ||
+                                       frame.settings.max_ray_reflections != lastFrame.settings.max_ray_reflections ||
+                                       frame.settings.light_sampling != lastFrame.settings.light_sampling ||
+                                       frame.sceneVersion != lastFrame.sceneVersion;
+                    scheduler.restart(window.width, window.height, costChanged);
+                    lastFrame = frame;
+                }
 
-        // END RENDERING
-    }
+                setTraceUniforms(tileProgram);
+                frameTexture->bindImage(0, GL_WRITE_ONLY);
+                scheduler.renderFrame([&](Tile const &tile) {
+                    tileProgram.setIVec2("tile_origin", glm::ivec2(tile.x, tile.y));
+                    tileProgram.setIVec2("tile_size", glm::ivec2(tile.width, tile.height));
+                    tileProgram.dispatch((tile.width + 7) / 8, (tile.height + 7) / 8, 1);
+                });
+                ez::memoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+                presentProgram.use();
+                frameTexture->bind(0);
+                presentProgram.setInt("frame", 0);
+                vao.draw(GL_TRIANGLES, 0, 6);
+            }
+            else
+            {
+                globaldata.program.get()->use();
+                setTraceUniforms(*globaldata.program);
+                vao.draw(GL_TRIANGLES, 0, 6);
+            }
+
+            // Read back before ImGui draws on top of the frame
+            if (recording && !capture)
+            {
+                capture = std::make_unique<FrameCapture>(recordDirectory, recordFormat);
+            }
+            if (capture)
+            {
+                if (recording && !capture->needsFloatSource())
+                {
+                    capture->capture(window.width, window.height);
+                }
+                else if (recording && frameTexture)
+                {
+                    capture->capture(*frameTexture);
+                }
+                else
+                {
+                    capture->poll();
+                }
+            }
+
+            ImGui::Begin("<3");
 
+            ImGui::Text("%f", 1 / (glfwGetTime() - lastTime));
+            // ImGui's backend calls GL directly and is not counted
+            ImGui::Text("ezgl calls %u, skipped binds %u", glStats.calls, glStats.skipped);
+            lastTime = glfwGetTime();
+            ImGui::SliderFloat("Viewport Size", &globaldata.viewport_size, 1.0, 10.0);
+            ImGui::SliderFloat("Focal Length", &globaldata.focal_length, 1.0, 50.0);
+            ImGui::SliderFloat("Camera Z", &globaldata.camera_z, 0.0, 50.0);
+            ImGui::SliderFloat("Min Clip", &globaldata.t_min, 0.0, 10.0);
+            ImGui::SliderFloat("Max Clip", &globaldata.t_max, 10.0, 100.0);
+            ImGui::SliderInt("Max Reflections", &globaldata.max_ray_reflections, 1, 100);
+            ImGui::SliderInt("Max Samples", &globaldata.samples, 1, 100);
+            ImGui::Checkbox("Light Sampling", &globaldata.light_sampling);
+            ImGui::Checkbox("Tiled", &tiled);
+            if (tiled)
+            {
+                ImGui::SameLine();
+                ImGui::Text("%zu/%zu tiles, %.2f ms GPU", scheduler.tilesDone(), scheduler.tileCount(),
+                            scheduler.getLastFrameMs());
+                if (scheduler.getOverBudgetFrames() > 0)
+                {
+                    ImGui::Text("%llu frames over budget", (unsigned long long)scheduler.getOverBudgetFrames());
+                }
+                ImGui::SliderFloat("GPU Budget (ms)", &scheduler.budgetMs, 1.0, 33.0);
+                int tileSize = scheduler.getTileSize();
+                if (ImGui::SliderInt("Tile Size", &tileSize, 16, 256))
+                {
+                    scheduler.setTileSize(tileSize);
+                }
+            }
+            if (ImGui::CollapsingHeader("GPU Memory"))
+            {
+                ez::MemoryStats const &memory = ez::memoryStats();
+                ImGui::Text("%.2f MB, peak %.2f MB", memory.bytes / double(1 << 20),
+                            memory.peakBytes / double(1 << 20));
+                for (ez::ResourceType type :
+                     {ez::ResourceType::Buffer, ez::ResourceType::Texture, ez::ResourceType::Program})
+                {
+                    size_t t = size_t(type);
+                    // Each type peaks on its own, the maxima do not add up to the total peak
+                    ImGui::Text("%ss: %u, %.2f MB, max %.2f MB", ez::resourceTypeName(type), memory.typeCount[t],
+                                memory.typeBytes[t] / double(1 << 20), memory.typePeakBytes[t] / double(1 << 20));
+                }
+                if (ImGui::BeginTable("resources", 4, ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders))
+                {
+                    ImGui::TableSetupColumn("Label");
+                    ImGui::TableSetupColumn("KB");
+                    ImGui::TableSetupColumn("Usage");
+                    ImGui::TableSetupColumn("Allocations");
+                    ImGui::TableHeadersRow();
+                    for (auto const &[key, resource] : ez::resources())
+                    {
+                        ImGui::TableNextRow();
+                        ImGui::TableNextColumn();
+                        ImGui::TextUnformatted(resource.label.c_str());
+                        ImGui::TableNextColumn();
+                        ImGui::Text("%.1f", resource.bytes / 1024.0);
+                        ImGui::TableNextColumn();
+                        ImGui::TextUnformatted(ez::usageName(resource.usage).c_str());
+                        ImGui::TableNextColumn();
+                        ImGui::Text("%u", resource.allocations);
+                    }
+                    ImGui::EndTable();
+                }
+            }
+            ImGui::Checkbox("Record", &recording);
+            if (capture)
+            {
+                ImGui::SameLine();
+                ImGui::Text("%llu frames, %.3f ms (avg %.3f), %llu stalls",
+                            (unsigned long long)capture->getFramesWritten(), capture->getLastCaptureMs(),
+                            capture->getAverageCaptureMs(), (unsigned long long)capture->getStalls());
+            }
+            // Scene edits go through the command queue like every other producer
+            if (ImGui::Button("Add Sphere", ImVec2(30, 30)))
+            {
+                post(commands, AddSphere{Sphere(glm::vec3(0, 0, 0), 1.0)});
+            }
+
+            for (uint32_t i = 0; i < spheres.size(); i++)
+            {
+                ImGui::PushID(i);
+                if (ImGui::Button("Delete"))
+                {
+                    post(commands, RemoveSphere{i});
+                }
+                ImGui::SameLine();
+                if (ImGui::CollapsingHeader("Sphere"))
+                {
+                    Sphere sphere = spheres[i];
+                    bool positionUpdated = ImGui::SliderFloat3("Position", &sphere.origin.x, -5, 5);
+                    bool radiusUpdated = ImGui::SliderFloat("Radius", &sphere.radius, -2, 2);
+                    bool colorUpdated = ImGui::ColorPicker3("Color", &sphere.color.x);
+                    bool emissionUpdated = ImGui::ColorEdit3("Emission", &sphere.emission.x,
+                                                             ImGuiColorEditFlags_HDR | ImGuiColorEditFlags_Float);
+                    if (positionUpdated || colorUpdated || radiusUpdated || emissionUpdated)
+                    {
+                        post(commands, UpdateSphere{i, sphere});
+                    }
+                }
+
+                ImGui::PopID();
+            }
+            ImGui::End();
+
+            glStats = ez::endFrame();
+            window.endDrawing();
+
+            // END RENDERING
+        }
+
+        // Stops the file watcher before the queue it posts to goes away
+        globaldata.program.reset();
+    }
+    ez::logMemoryUsage();
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,483 @@
+#include "mesh.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <spdlog/spdlog.h>
+
+// Area weighted vertex normals, for files that come without any
+static void computeNormals(Mesh &mesh)
+{
+    mesh.normals.assign(mesh.positions.size(), glm::vec3(0));
+    for (glm::uvec3 const &t : mesh.triangles)
+    {
+        glm::vec3 n = glm::cross(mesh.positions[t.y] - mesh.positions[t.x], mesh.positions[t.z] - mesh.positions[t.x]);
+        mesh.normals[t.x] += n;
+        mesh.normals[t.y] += n;
+        mesh.normals[t.z] += n;
+    }
+    for (glm::vec3 &n : mesh.normals)
+    {
+        float length = glm::length(n);
+        n = length > 0 ? n / length : glm::vec3(0, 0, 1);
+    }
+}
+
+// Parses one OBJ index, negative ones count back from the last element
+static bool objIndex(char const *text, char **end, size_t count, int64_t &index)
+{
+    int64_t value = std::strtoll(text, end, 10);
+    if (*end == text || value == 0)
+    {
+        return false;
+    }
+    index = value < 0 ? int64_t(count) + value : value - 1;
+    return index >= 0 && index < int64_t(count);
+}
+
+bool loadOBJ(std::string const &path, Mesh &mesh)
+{
+    std::ifstream stream(path);
+    if (not stream)
+    {
+        spdlog::error("Unable to open file {}", path);
+        return false;
+    }
+
+    mesh = Mesh();
+    std::vector<glm::vec3> positions, normals;
+    // Corners that share position and normal become one vertex
+    std::map<std::pair<int64_t, int64_t>, uint32_t> vertices;
+    bool hasNormals = true;
+    std::string line, tag, corner;
+    std::vector<uint32_t> face;
+    for (uint32_t lineNumber = 1; std::getline(stream, line); lineNumber++)
+    {
+        std::istringstream in(line);
+        in >> tag;
+        if (tag == "v" || tag == "vn")
+        {
+            glm::vec3 v;
+            in >> v.x >> v.y >> v.z;
+            (tag == "v" ? positions : normals).push_back(v);
+        }
+        else if (tag == "f")
+        {
+            face.clear();
+            while (in >> corner)
+            {
+                // v, v/vt, v//vn or v/vt/vn
+                char *end;
+                int64_t v, vn = -1;
+                bool valid = objIndex(corner.c_str(), &end, positions.size(), v);
+                char const *slash = std::strchr(corner.c_str(), '/');
+                slash = slash ? std::strchr(slash + 1, '/') : nullptr;
+                if (slash && slash[1] != 0)
+                {
+                    valid = valid && objIndex(slash + 1, &end, normals.size(), vn);
+                }
+                if (!valid)
+                {
+                    spdlog::error("{}:{}: invalid face corner {}", path, lineNumber, corner);
+                    return false;
+                }
+                hasNormals = hasNormals && vn >= 0;
+
+                auto [it, added] = vertices.try_emplace({v, vn}, mesh.positions.size());
+                if (added)
+                {
+                    mesh.positions.push_back(positions[v]);
+                    mesh.normals.push_back(vn >= 0 ? normals[vn] : glm::vec3(0));
+                }
+                face.push_back(it->second);
+            }
+            for (size_t i = 2; i < face.size(); i++)
+            {
+                mesh.triangles.push_back(glm::uvec3(face[0], face[i - 1], face[i]));
+            }
+        }
+        tag.clear();
+    }
+    if (!hasNormals || mesh.triangles.empty())
+    {
+        computeNormals(mesh);
+    }
+    return true;
+}
+
+template <typename T> static double plyValue(uint8_t const *bytes)
+{
+    T value;
+    std::memcpy(&value, bytes, sizeof(T));
+    return value;
+}
+
+namespace
+{
+struct PlyType
+{
+    std::string_view name, alias;
+    size_t size;
+    double (*convert)(uint8_t const *bytes);
+};
+
+constexpr PlyType plyTypes[] = {
+    {"char", "int8", 1, plyValue<int8_t>},      {"uchar", "uint8", 1, plyValue<uint8_t>},
+    {"short", "int16", 2, plyValue<int16_t>},   {"ushort", "uint16", 2, plyValue<uint16_t>},
+    {"int", "int32", 4, plyValue<int32_t>},     {"uint", "uint32", 4, plyValue<uint32_t>},
+    {"float", "float32", 4, plyValue<float>},   {"double", "float64", 8, plyValue<double>},
+};
+
+struct PlyProperty
+{
+    std::string name;
+    PlyType const *type = nullptr;
+    // Type of the element count for list properties
+    PlyType const *countType = nullptr;
+};
+
+struct PlyElement
+{
+    std::string name;
+    size_t count;
+    std::vector<PlyProperty> properties;
+};
+
+class PlyReader
+{
+  private:
+    std::istream &stream;
+    bool ascii;
+    bool bigEndian;
+
+  public:
+    PlyReader(std::istream &stream, bool ascii, bool bigEndian) : stream(stream), ascii(ascii), bigEndian(bigEndian)
+    {
+    }
+
+    double read(PlyType const &type)
+    {
+        if (ascii)
+        {
+            double value = 0;
+            stream >> value;
+            return value;
+        }
+        uint8_t bytes[8];
+        stream.read(reinterpret_cast<char *>(bytes), type.size);
+        if (bigEndian)
+        {
+            std::reverse(bytes, bytes + type.size);
+        }
+        return type.convert(bytes);
+    }
+
+    bool ok()
+    {
+        return bool(stream);
+    }
+};
+} // namespace
+
+static PlyType const *plyType(std::string const &name)
+{
+    for (PlyType const &type : plyTypes)
+    {
+        if (type.name == name || type.alias == name)
+        {
+            return &type;
+        }
+    }
+    return nullptr;
+}
+
+bool loadPLY(std::string const &path, Mesh &mesh)
+{
+    std::ifstream stream(path, std::ios::binary);
+    if (not stream)
+    {
+        spdlog::error("Unable to open file {}", path);
+        return false;
+    }
+
+    std::string line, format;
+    std::vector<PlyElement> elements;
+    std::getline(stream, line);
+    if (line.rfind("ply", 0) != 0)
+    {
+        spdlog::error("{} is not a PLY file", path);
+        return false;
+    }
+    while (std::getline(stream, line))
+    {
+        if (!line.empty() && line.back() == '\r')
+        {
+            line.pop_back();
+        }
+        std::istringstream in(line);
+        std::string keyword;
+        in >> keyword;
+        if (keyword == "format")
+        {
+            in >> format;
+        }
+        else if (keyword == "element")
+        {
+            PlyElement element;
+            in >> element.name >> element.count;
+            elements.push_back(element);
+        }
+        else if (keyword == "property" && !elements.empty())
+        {
+            PlyProperty property;
+            std::string type, countType;
+            in >> type;
+            if (type == "list")
+            {
+                in >> countType >> type;
+                property.countType = plyType(countType);
+            }
+            in >> property.name;
+            property.type = plyType(type);
+            if (!property.type || (!countType.empty() && !property.countType))
+            {
+                spdlog::error("{}: unknown property type in '{}'", path, line);
+                return false;
+            }
+            elements.back().properties.push_back(property);
+        }
+        else if (keyword == "end_header")
+        {
+            break;
+        }
+    }
+    if (format != "ascii" && format != "binary_little_endian" && format != "binary_big_endian")
+    {
+        spdlog::error("{}: unsupported format '{}'", path, format);
+        return false;
+    }
+
+    mesh = Mesh();
+    bool hasNormals = false;
+    PlyReader reader(stream, format == "ascii", format == "binary_big_endian");
+    std::vector<uint32_t> face;
+    for (PlyElement const &element : elements)
+    {
+        // Where each property goes: x, y, z, nx, ny, nz of a vertex or -1 when it is skipped
+        std::vector<int32_t> slots;
+        for (PlyProperty const &property : element.properties)
+        {
+            static const char *names[] = {"x", "y", "z", "nx", "ny", "nz"};
+            auto it = std::find(std::begin(names), std::end(names), property.name);
+            slots.push_back(element.name == "vertex" && it != std::end(names) ? it - std::begin(names) : -1);
+            hasNormals = hasNormals || (element.name == "vertex" && property.name == "nx");
+        }
+
+        for (size_t i = 0; i < element.count && reader.ok(); i++)
+        {
+            float values[6] = {};
+            for (size_t p = 0; p < element.properties.size(); p++)
+            {
+                PlyProperty const &property = element.properties[p];
+                if (!property.countType)
+                {
+                    double value = reader.read(*property.type);
+                    if (slots[p] >= 0)
+                    {
+                        values[slots[p]] = value;
+                    }
+                    continue;
+                }
+
+                uint32_t count = reader.read(*property.countType);
+                bool indices = element.name == "face" &&
+                               (property.name == "vertex_indices" || property.name == "vertex_index");
+                face.clear();
+                for (uint32_t j = 0; j < count; j++)
+                {
+                    face.push_back(reader.read(*property.type));
+                }
+                for (size_t j = 2; indices && j < face.size(); j++)
+                {
+                    mesh.triangles.push_back(glm::uvec3(face[0], face[j - 1], face[j]));
+                }
+            }
+            if (element.name == "vertex")
+            {
+                mesh.positions.push_back(glm::vec3(values[0], values[1], values[2]));
+                mesh.normals.push_back(glm::vec3(values[3], values[4], values[5]));
+            }
+        }
+    }
+    if (!reader.ok())
+    {
+        spdlog::error("{} is truncated", path);
+        return false;
+    }
+    for (glm::uvec3 const &t : mesh.triangles)
+    {
+        if (std::max({t.x, t.y, t.z}) >= mesh.positions.size())
+        {
+            spdlog::error("{}: face references a missing vertex", path);
+            return false;
+        }
+    }
+    if (!hasNormals)
+    {
+        computeNormals(mesh);
+    }
+    return true;
+}
+
+bool loadMesh(std::string const &path, Mesh &mesh)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::string extension = std::filesystem::path(path).extension().string();
+    bool loaded;
+    if (extension == ".obj")
+    {
+        loaded = loadOBJ(path, mesh);
+    }
+    else if (extension == ".ply")
+    {
+        loaded = loadPLY(path, mesh);
+    }
+    else
+    {
+        spdlog::error("No mesh loader for {}", path);
+        return false;
+    }
+    if (loaded)
+    {
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        spdlog::info("Loaded {}: {} triangles, {} vertices in {:.1f} ms", path, mesh.triangles.size(),
+                     mesh.positions.size(), ms);
+    }
+    return loaded;
+}
+
+void fitMesh(Mesh &mesh, glm::vec3 center, float size)
+{
+    if (mesh.positions.empty())
+    {
+        return;
+    }
+    glm::vec3 min = mesh.positions[0], max = mesh.positions[0];
+    for (glm::vec3 const &p : mesh.positions)
+    {
+        min = glm::min(min, p);
+        max = glm::max(max, p);
+    }
+    glm::vec3 extent = max - min;
+    float longest = std::max({extent.x, extent.y, extent.z});
+    float scale = longest > 0 ? size / longest : 1;
+    for (glm::vec3 &p : mesh.positions)
+    {
+        p = (p - (min + max) * 0.5f) * scale + center;
+    }
+}
+
+/* Packing */
+
+static constexpr uint32_t xyBits = 21, zBits = 22;
+
+static uint32_t quantize(float v, float min, float extent, uint32_t bits)
+{
+    uint32_t steps = (1u << bits) - 1;
+    if (extent <= 0)
+    {
+        return 0;
+    }
+    return std::clamp<int64_t>(std::llround((v - min) / extent * steps), 0, steps);
+}
+
+// Octahedral encoding, matches unpackSnorm2x16 in GLSL
+static uint32_t packNormal(glm::vec3 n)
+{
+    float sum = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+    n = sum > 0 ? n / sum : glm::vec3(0, 0, 1);
+    glm::vec2 e(n.x, n.y);
+    if (n.z < 0)
+    {
+        e = glm::vec2((1 - std::fabs(n.y)) * (n.x >= 0 ? 1 : -1), (1 - std::fabs(n.x)) * (n.y >= 0 ? 1 : -1));
+    }
+    auto snorm = [](float v) { return uint32_t(uint16_t(int16_t(std::lround(std::clamp(v, -1.0f, 1.0f) * 32767)))); };
+    return snorm(e.x) | snorm(e.y) << 16;
+}
+
+glm::vec3 unpackNormal(uint32_t word)
+{
+    glm::vec2 e(std::max(int16_t(word & 0xffff) / 32767.0f, -1.0f), std::max(int16_t(word >> 16) / 32767.0f, -1.0f));
+    glm::vec3 n(e.x, e.y, 1 - std::fabs(e.x) - std::fabs(e.y));
+    float t = std::max(-n.z, 0.0f);
+    n.x += n.x >= 0 ? -t : t;
+    n.y += n.y >= 0 ? -t : t;
+    return glm::normalize(n);
+}
+
+glm::vec3 unpackPosition(MeshInfo const &mesh, uint32_t const *vertex)
+{
+    uint32_t x = vertex[0] & ((1u << xyBits) - 1);
+    uint32_t y = vertex[0] >> xyBits | (vertex[1] & ((1u << (2 * xyBits - 32)) - 1)) << (32 - xyBits);
+    uint32_t z = vertex[1] >> (2 * xyBits - 32);
+    glm::vec3 q(x / float((1u << xyBits) - 1), y / float((1u << xyBits) - 1), z / float((1u << zBits) - 1));
+    return mesh.bounds_min + q * mesh.bounds_extent;
+}
+
+size_t MeshBuffers::triangleCount() const
+{
+    return indices.size() / 3;
+}
+
+size_t MeshBuffers::bytes() const
+{
+    return meshes.size() * sizeof(MeshInfo) + (vertices.size() + indices.size()) * sizeof(uint32_t);
+}
+
+MeshBuffers packMeshes(std::vector<Mesh> const &meshes)
+{
+    MeshBuffers buffers;
+    for (Mesh const &mesh : meshes)
+    {
+        if (mesh.triangles.empty())
+        {
+            continue;
+        }
+        glm::vec3 min = mesh.positions[0], max = mesh.positions[0];
+        for (glm::vec3 const &p : mesh.positions)
+        {
+            min = glm::min(min, p);
+            max = glm::max(max, p);
+        }
+
+        MeshInfo info;
+        info.bounds_min = min;
+        info.bounds_extent = max - min;
+        info.first_vertex = buffers.vertices.size() / vertexWords;
+        info.first_triangle = buffers.indices.size() / 3;
+        info.triangle_count = mesh.triangles.size();
+        info.color = mesh.color;
+        info.emission = mesh.emission;
+        buffers.meshes.push_back(info);
+
+        for (size_t i = 0; i < mesh.positions.size(); i++)
+        {
+            glm::vec3 const &p = mesh.positions[i];
+            uint32_t x = quantize(p.x, min.x, info.bounds_extent.x, xyBits);
+            uint32_t y = quantize(p.y, min.y, info.bounds_extent.y, xyBits);
+            uint32_t z = quantize(p.z, min.z, info.bounds_extent.z, zBits);
+            buffers.vertices.push_back(x | y << xyBits);
+            buffers.vertices.push_back(y >> (32 - xyBits) | z << (2 * xyBits - 32));
+            buffers.vertices.push_back(packNormal(mesh.normals[i]));
+        }
+        for (glm::uvec3 const &t : mesh.triangles)
+        {
+            buffers.indices.insert(buffers.indices.end(), {t.x, t.y, t.z});
+        }
+    }
+    return buffers;
+}
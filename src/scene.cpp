@@ -0,0 +1,62 @@
+#include "scene.hpp"
+#include <spdlog/spdlog.h>
+
+std::vector<Sphere> defaultScene()
+{
+    std::vector<Sphere> spheres;
+    spheres.push_back(Sphere(glm::vec3(0, -0.2, 5), 1.0, glm::vec3(1, 0, 0)));
+    spheres.push_back(Sphere(glm::vec3(0, -51, 0), 50, glm::vec3(0, 1, 0)));
+    spheres.push_back(Sphere(glm::vec3(2, 0, 0), 0.3, glm::vec3(0, 0, 1)));
+    return spheres;
+}
+
+std::vector<Sphere> indoorScene()
+{
+    std::vector<Sphere> spheres;
+    // Walls are huge spheres so the room stays closed without a plane primitive
+    spheres.push_back(Sphere(glm::vec3(0, -1001.2, 0), 1000, glm::vec3(0.75, 0.75, 0.75)));
+    spheres.push_back(Sphere(glm::vec3(0, 1003.0, 0), 1000, glm::vec3(0.75, 0.75, 0.75)));
+    spheres.push_back(Sphere(glm::vec3(-1003.0, 0, 0), 1000, glm::vec3(0.75, 0.25, 0.25)));
+    spheres.push_back(Sphere(glm::vec3(1003.0, 0, 0), 1000, glm::vec3(0.25, 0.75, 0.25)));
+    spheres.push_back(Sphere(glm::vec3(0, 0, -1004.0), 1000, glm::vec3(0.75, 0.75, 0.75)));
+    spheres.push_back(Sphere(glm::vec3(0, 0, 1020.0), 1000, glm::vec3(0.75, 0.75, 0.75)));
+
+    spheres.push_back(Sphere(glm::vec3(-0.8, -0.2, 0), 1.0, glm::vec3(0.8, 0.8, 0.8)));
+    spheres.push_back(Sphere(glm::vec3(1.6, -0.7, 1.5), 0.5, glm::vec3(0.2, 0.3, 0.9)));
+
+    spheres.push_back(Sphere(glm::vec3(-1.0, 2.5, 0.5), 0.2, glm::vec3(0.9, 0.9, 0.9), glm::vec3(40, 36, 30)));
+    spheres.push_back(Sphere(glm::vec3(1.5, 2.5, 2.5), 0.15, glm::vec3(0.9, 0.9, 0.9), glm::vec3(30, 30, 40)));
+    return spheres;
+}
+
+std::vector<Sphere> sceneByName(std::string const &name)
+{
+    if (name == "default")
+    {
+        return defaultScene();
+    }
+    if (name == "indoor")
+    {
+        return indoorScene();
+    }
+    spdlog::error("Unknown scene {}", name);
+    exit(EXIT_FAILURE);
+}
+
+std::vector<std::string> sceneNames()
+{
+    return {"default", "indoor"};
+}
+
+std::vector<int32_t> lightIndices(std::vector<Sphere> const &spheres)
+{
+    std::vector<int32_t> lights;
+    for (uint32_t i = 0; i < spheres.size(); i++)
+    {
+        if (spheres[i].isEmissive())
+        {
+            lights.push_back(i);
+        }
+    }
+    return lights;
+}
@@ -0,0 +1,131 @@
+#include "sweep.hpp"
+#include "ezgl.hpp"
+#include <chrono>
+#include <fstream>
+#include <nlohmann/json.hpp>
+#include <spdlog/spdlog.h>
+
+using json = nlohmann::json;
+
+std::vector<SweepParams> loadSweep(std::string const &path, TraceSettings const &defaults)
+{
+    std::ifstream stream(path);
+    if (not stream)
+    {
+        spdlog::error("File {} does not exist", path);
+        exit(EXIT_FAILURE);
+    }
+
+    // value() and at() throw on entries that are not objects or hold the wrong types
+    std::vector<SweepParams> sweep;
+    try
+    {
+        json document = json::parse(stream);
+        if (!document.is_array() || document.empty())
+        {
+            spdlog::error("{} has to contain a non-empty array of parameter sets", path);
+            exit(EXIT_FAILURE);
+        }
+        for (json const &entry : document)
+        {
+            SweepParams p;
+            p.viewport_size = entry.value("viewport_size", defaults.viewport_size);
+            p.focal_length = entry.value("focal_length", defaults.focal_length);
+            p.camera_z = entry.value("camera_z", defaults.camera_z);
+            p.t_min = entry.value("t_min", defaults.t_min);
+            p.t_max = entry.value("t_max", defaults.t_max);
+            p.max_ray_reflections = entry.value("max_ray_reflections", defaults.max_ray_reflections);
+            p.samples = entry.value("samples", defaults.samples);
+            p.light_sampling = entry.value("light_sampling", defaults.light_sampling);
+            p.color_sphere = entry.value("color_sphere", -1);
+            if (entry.contains("color"))
+            {
+                json const &c = entry.at("color");
+                p.color = glm::vec3(c.at(0).get<float>(), c.at(1).get<float>(), c.at(2).get<float>());
+            }
+            sweep.push_back(p);
+        }
+    }
+    catch (json::exception const &e)
+    {
+        spdlog::error("Could not parse {}\n{}", path, e.what());
+        exit(EXIT_FAILURE);
+    }
+    spdlog::info("Loaded {} parameter sets from {}", sweep.size(), path);
+    return sweep;
+}
+
+SweepResult renderSweep(std::vector<SweepParams> const &sweep, std::vector<Sphere> const &spheres,
+                        MeshBuffers const &meshes, int32_t width, int32_t height, bool compareSequential)
+{
+    ez::Program program({{GL_COMPUTE_SHADER, "shaders/sweep.csh"}});
+    std::vector<int32_t> lights = lightIndices(spheres);
+
+    ez::SSBO sphereSSBO("sweep spheres");
+    sphereSSBO.setData(spheres.data(), spheres.size());
+    ez::SSBO lightSSBO("sweep lights");
+    lightSSBO.setData(lights.data(), lights.size());
+    ez::SSBO meshSSBO("sweep meshes"), meshVertexSSBO("sweep mesh vertices"), meshIndexSSBO("sweep mesh indices");
+    meshSSBO.setData(meshes.meshes.data(), meshes.meshes.size());
+    meshVertexSSBO.setData(meshes.vertices.data(), meshes.vertices.size());
+    meshIndexSSBO.setData(meshes.indices.data(), meshes.indices.size());
+    ez::SSBO sweepSSBO("sweep parameters");
+    sweepSSBO.setData(sweep.data(), sweep.size());
+    ez::TextureArray images(width, height, sweep.size(), "sweep images");
+
+    sphereSSBO.layout(3);
+    lightSSBO.layout(4);
+    sweepSSBO.layout(5);
+    meshSSBO.layout(6);
+    meshVertexSSBO.layout(7);
+    meshIndexSSBO.layout(8);
+    images.bindImage(0, GL_WRITE_ONLY);
+    program.setInt("numSpheres", spheres.size());
+    program.setInt("numLights", lights.size());
+    program.setInt("numMeshes", meshes.meshes.size());
+
+    GLuint groupsX = (width + 7) / 8;
+    GLuint groupsY = (height + 7) / 8;
+    auto now = []() { return std::chrono::steady_clock::now(); };
+    auto seconds = [](auto duration) { return std::chrono::duration<double>(duration).count(); };
+    SweepResult result;
+
+    // Warm up so neither timing pays for shader compilation on first use
+    program.setInt("layer_offset", 0);
+    program.dispatch(groupsX, groupsY, 1);
+    glFinish();
+
+    if (compareSequential)
+    {
+        auto start = now();
+        for (uint32_t i = 0; i < sweep.size(); i++)
+        {
+            program.setInt("layer_offset", i);
+            program.dispatch(groupsX, groupsY, 1);
+        }
+        glFinish();
+        result.sequentialSeconds = seconds(now() - start);
+        program.setInt("layer_offset", 0);
+    }
+
+    auto start = now();
+    program.dispatch(groupsX, groupsY, sweep.size());
+    glFinish();
+    result.batchedSeconds = seconds(now() - start);
+
+    ez::memoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+    std::vector<float> pixels = images.read();
+
+    size_t layerSize = size_t(width) * height * 4;
+    for (uint32_t layer = 0; layer < sweep.size(); layer++)
+    {
+        Image image(width, height);
+        float const *src = pixels.data() + layer * layerSize;
+        for (size_t i = 0; i < image.pixels.size(); i++)
+        {
+            image.pixels[i] = glm::vec3(src[i * 4], src[i * 4 + 1], src[i * 4 + 2]);
+        }
+        result.images.push_back(std::move(image));
+    }
+    return result;
+}
@@ -0,0 +1,203 @@
+#include "tile_scheduler.hpp"
+#include <algorithm>
+#include <spdlog/spdlog.h>
+
+// One workgroup of tile.csh
+static constexpr int32_t minTileSize = 8;
+
+TileScheduler::TileScheduler(int32_t tileSize, float budgetMs) : tileSize(tileSize), budgetMs(budgetMs)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        measurements.push_back(std::make_unique<Measurement>());
+    }
+}
+
+void TileScheduler::restart(int32_t width, int32_t height, bool resetEstimate)
+{
+    if (resetEstimate)
+    {
+        msPerPixel = 0;
+        for (auto &m : measurements)
+        {
+            // Still have to be read before the query object can be reused
+            m->pixels = 0;
+        }
+    }
+    next = 0;
+    if (width == this->width && height == this->height && !tiles.empty() && !split)
+    {
+        return;
+    }
+
+    split = false;
+    this->width = width;
+    this->height = height;
+    tiles.clear();
+    for (int32_t y = 0; y < height; y += tileSize)
+    {
+        for (int32_t x = 0; x < width; x += tileSize)
+        {
+            tiles.push_back(Tile{x, y, std::min(tileSize, width - x), std::min(tileSize, height - y)});
+        }
+    }
+    auto distance = [&](Tile const &t) {
+        int64_t dx = 2 * t.x + t.width - width;
+        int64_t dy = 2 * t.y + t.height - height;
+        return dx * dx + dy * dy;
+    };
+    std::stable_sort(tiles.begin(), tiles.end(),
+                     [&](Tile const &a, Tile const &b) { return distance(a) < distance(b); });
+}
+
+void TileScheduler::setTileSize(int32_t tileSize)
+{
+    if (tileSize == this->tileSize)
+    {
+        return;
+    }
+    this->tileSize = tileSize;
+    tiles.clear();
+    restart(width, height);
+}
+
+int32_t TileScheduler::getTileSize()
+{
+    return tileSize;
+}
+
+void TileScheduler::collect()
+{
+    for (auto &m : measurements)
+    {
+        if (!m->pending || !m->query.available())
+        {
+            continue;
+        }
+        double ms = m->query.milliseconds();
+        m->pending = false;
+        if (m->pixels == 0)
+        {
+            continue;
+        }
+        lastFrameMs = ms;
+        double sample = ms / m->pixels;
+        msPerPixel = msPerPixel == 0 ? sample : 0.7 * msPerPixel + 0.3 * sample;
+    }
+}
+
+void TileScheduler::splitNext()
+{
+    while (true)
+    {
+        Tile tile = tiles[next];
+        // Without an estimate the cost is unknown, start with the smallest tile
+        bool fits = msPerPixel > 0 && int64_t(tile.width) * tile.height * msPerPixel <= budgetMs;
+        if (fits || (tile.width <= minTileSize && tile.height <= minTileSize))
+        {
+            return;
+        }
+        // Halve the longer side, the first half stays a multiple of the workgroup size
+        Tile first = tile, second = tile;
+        if (tile.width >= tile.height)
+        {
+            first.width = (tile.width / 2 + minTileSize - 1) / minTileSize * minTileSize;
+            second.x += first.width;
+            second.width -= first.width;
+        }
+        else
+        {
+            first.height = (tile.height / 2 + minTileSize - 1) / minTileSize * minTileSize;
+            second.y += first.height;
+            second.height -= first.height;
+        }
+        tiles[next] = first;
+        tiles.insert(tiles.begin() + next + 1, second);
+        split = true;
+    }
+}
+
+void TileScheduler::renderFrame(std::function<void(Tile const &)> const &renderTile)
+{
+    collect();
+    if (done())
+    {
+        return;
+    }
+
+    // Without a free query this frame goes unmeasured rather than waiting for the GPU
+    Measurement &m = *measurements[measurementHead];
+    bool measure = !m.pending;
+    if (measure)
+    {
+        m.query.begin();
+        m.pixels = 0;
+    }
+
+    splitNext();
+    bool estimated = msPerPixel > 0;
+    double spentMs = 0;
+    int64_t pixels = 0;
+    do
+    {
+        Tile const &tile = tiles[next++];
+        renderTile(tile);
+        int64_t tilePixels = int64_t(tile.width) * tile.height;
+        pixels += tilePixels;
+        spentMs += tilePixels * msPerPixel;
+    } while (!done() && msPerPixel > 0 &&
+             spentMs + int64_t(tiles[next].width) * tiles[next].height * msPerPixel <= budgetMs);
+
+    // Tiles are only added while the estimate says they fit, so this takes a minimum size tile over budget
+    if (estimated && spentMs > budgetMs)
+    {
+        if (overBudgetFrames++ == 0)
+        {
+            spdlog::warn("A {}x{} tile takes {:.1f} ms, more than the {:.1f} ms budget", minTileSize, minTileSize,
+                         spentMs, budgetMs);
+        }
+    }
+
+    if (measure)
+    {
+        m.query.end();
+        m.pixels = pixels;
+        m.pending = true;
+        measurementHead = (measurementHead + 1) % measurements.size();
+    }
+}
+
+bool TileScheduler::done()
+{
+    return next >= tiles.size();
+}
+
+float TileScheduler::progress()
+{
+    return tiles.empty() ? 1.0f : float(next) / tiles.size();
+}
+
+size_t TileScheduler::tilesDone()
+{
+    return next;
+}
+
+size_t TileScheduler::tileCount()
+{
+    return tiles.size();
+}
+
+double TileScheduler::getMsPerPixel()
+{
+    return msPerPixel;
+}
+
+double TileScheduler::getLastFrameMs()
+{
+    return lastFrameMs;
+}
+
+uint64_t TileScheduler::getOverBudgetFrames()
+{
+    return overBudgetFrames;
+}
@@ -1,5 +1,6 @@
 #include "window.hpp"
 #include "GLFW/glfw3.h"
+#include "ezgl.hpp"
 #include <spdlog/spdlog.h>
 
 #include "backends/imgui_impl_glfw.h"
@@ -129,6 +130,7 @@ Window::Window(int32_t width, int32_t height, const char *name)
 
     // Loading glad
     gladLoadGL();
+    ez::loadExtensions((GLADloadproc)glfwGetProcAddress);
 
     glEnable(GL_DEBUG_OUTPUT);
     glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
@@ -188,8 +190,8 @@ bool Window::shouldClose()
 void Window::startDrawing()
 {
     glfwGetFramebufferSize(this->w, &this->width, &this->height);
-    glViewport(0, 0, width, height);
-    glClear(GL_COLOR_BUFFER_BIT);
+    ez::viewport(0, 0, width, height);
+    ez::clear(GL_COLOR_BUFFER_BIT);
 
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplGlfw_NewFrame();